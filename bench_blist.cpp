@@ -0,0 +1,379 @@
+#include "blist.hpp"
+#include "static_deque.hpp"
+#include "static_vector.hpp"
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <list>
+#include <numeric>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+// Benchmarks of blist and static_vector against the standard containers.
+// Every container of every element type is timed on construction from a
+// range, push_back, push_front, insert and erase at random positions,
+// operator[] at random positions and a full scan, best of three runs. The
+// results are written to stdout as JSON, one record per measurement, so that
+// runs can be compared by a script. Operations a container does not have
+// (or only in linear time, such as push_front of std::vector) are skipped.
+//
+// The sweep mode times blist for a grid of leaf byte budgets and fanouts,
+// which is what the default node capacities are chosen by.
+//
+// Usage: blist_bench [number of elements]
+//        blist_bench sweep [number of elements]
+
+using bench_clock = std::chrono::steady_clock;
+
+// element that spans a whole cache line
+struct line {
+    std::array< long long, 8 > v;
+    line( long long x = 0 ) : v{ x } { }
+};
+
+template< typename T >
+static T make( size_t i ) {
+    if constexpr ( std::is_same_v< T, std::string > )
+        return "a string that does not fit into SSO " + std::to_string( i );
+    else
+        return T( i );
+}
+
+static long long key( int x ) { return x; }
+static long long key( const line &x ) { return x.v[ 0 ]; }
+static long long key( const std::string &x ) { return static_cast< long long >( x.size() ); }
+
+template< typename T > const char *type_name();
+template<> const char *type_name< int >() { return "int"; }
+template<> const char *type_name< line >() { return "line"; }
+template<> const char *type_name< std::string >() { return "string"; }
+
+struct result {
+    std::string container;
+    std::string element;
+    std::string op;
+    size_t size;
+    double ns_per_op;
+};
+
+static std::vector< result > results;
+// sink for values computed by the benchmarks, so that they are not optimized out
+static volatile long long sink;
+
+// Runs setup() and then body() three times, records the best time of body
+// divided by ops.
+template< typename Setup, typename Body >
+static void measure( const std::string &container, const char *element, const char *op,
+                     size_t size, size_t ops, Setup setup, Body body ) {
+    double best = 0;
+    for ( int r = 0; r < 3; ++r ) {
+        auto state = setup();
+        auto start = bench_clock::now();
+        body( state );
+        std::chrono::duration< double > t = bench_clock::now() - start;
+        if ( r == 0 || t.count() < best )
+            best = t.count();
+    }
+    results.push_back( { container, element, op, size, best * 1e9 / double( ops ) } );
+}
+
+template< typename C >
+constexpr bool is_list = std::is_same_v< C, std::list< typename C::value_type > >;
+template< typename C >
+constexpr bool is_vector = std::is_same_v< C, std::vector< typename C::value_type > >;
+
+template< typename C >
+static auto at( C &c, size_t i ) {
+    if constexpr ( is_list< C > )
+        return std::next( c.begin(), i );
+    else
+        return c.begin() + i;
+}
+
+template< typename C >
+static void bench_container( const std::string &name, size_t n ) {
+    using T = typename C::value_type;
+    const char *elem = type_name< T >();
+    std::vector< T > vals;
+    vals.reserve( n );
+    for ( size_t i = 0; i < n; ++i )
+        vals.push_back( make< T >( i ) );
+    auto none = [] { return 0; };
+    auto filled = [&] { return C( vals.begin(), vals.end() ); };
+
+    measure( name, elem, "construct", n, n, none, [&]( int ) {
+            C c( vals.begin(), vals.end() );
+            sink = static_cast< long long >( c.size() );
+        } );
+    measure( name, elem, "push_back", n, n, none, [&]( int ) {
+            C c;
+            for ( auto &v : vals )
+                c.push_back( v );
+            sink = static_cast< long long >( c.size() );
+        } );
+    if constexpr ( !is_vector< C > ) {
+        measure( name, elem, "push_front", n, n, none, [&]( int ) {
+                C c;
+                for ( auto &v : vals )
+                    c.push_front( v );
+                sink = static_cast< long long >( c.size() );
+            } );
+    }
+
+    // positional edits cost O(n) in a std::list and a std::vector, do less
+    // of them there
+    size_t ops = is_list< C > || is_vector< C > ? std::min< size_t >( n / 10, 1000 ) : n / 10;
+    std::vector< size_t > pos( ops );
+    std::mt19937_64 rng( 7 );
+    for ( size_t i = 0; i < ops; ++i )
+        pos[ i ] = rng() % ( n + 1 );
+    measure( name, elem, "insert", n, ops, filled, [&]( C &c ) {
+            for ( size_t i = 0; i < ops; ++i )
+                c.insert( at( c, pos[ i ] % ( c.size() + 1 ) ), vals[ i ] );
+        } );
+    measure( name, elem, "erase", n, ops, filled, [&]( C &c ) {
+            for ( size_t i = 0; i < ops; ++i )
+                c.erase( at( c, pos[ i ] % c.size() ) );
+        } );
+
+    // the values of key( x ) are scattered by the multiplier
+    auto scattered = []( const T &a, const T &b ) {
+        return key( a ) * 2654435761LL % 1000003 < key( b ) * 2654435761LL % 1000003;
+    };
+    measure( name, elem, "sort", n, n, filled, [&]( C &c ) {
+            if constexpr ( is_vector< C > || std::is_same_v< C, std::deque< T > > )
+                std::sort( c.begin(), c.end(), scattered );
+            else
+                c.sort( scattered );
+        } );
+
+    C c( vals.begin(), vals.end() );
+    if constexpr ( !is_list< C > ) {
+        std::vector< size_t > idxs( 1'000'000 );
+        for ( auto &i : idxs )
+            i = rng() % n;
+        measure( name, elem, "operator[]", n, idxs.size(), none, [&]( int ) {
+                long long sum = 0;
+                for ( size_t i : idxs )
+                    sum += key( c[ i ] );
+                sink = sum;
+            } );
+    }
+    measure( name, elem, "scan", n, n, none, [&]( int ) {
+            long long sum = 0;
+            for ( auto &v : c )
+                sum += key( v );
+            sink = sum;
+        } );
+    if constexpr ( !is_list< C > && !is_vector< C > && !std::is_same_v< C, std::deque< T > > ) {
+        // through the segmented accumulate found by ADL
+        measure( name, elem, "scan_segmented", n, n, none, [&]( int ) {
+                sink = accumulate( c.begin(), c.end(), 0LL,
+                                   []( long long a, const T &x ) { return a + key( x ); } );
+            } );
+        // a run of inserts at a moving position, as typing into a buffer
+        measure( name, elem, "local_insert", n, ops, filled, [&]( C &c ) {
+                auto it = c.begin() + n / 2;
+                for ( size_t i = 0; i < ops; ++i )
+                    it = std::next( c.insert( it, vals[ i ] ) );
+            } );
+        measure( name, elem, "cursor_insert", n, ops, filled, [&]( C &c ) {
+                auto cur = c.cursor_at( c.begin() + n / 2 );
+                for ( size_t i = 0; i < ops; ++i )
+                    cur.insert( vals[ i ] );
+            } );
+        // the random inserts of "insert" as a single batch
+        measure( name, elem, "batch_insert", n, ops, filled, [&]( C &c ) {
+                std::vector< blist_edit< T > > edits;
+                edits.reserve( ops );
+                for ( size_t i = 0; i < ops; ++i )
+                    edits.push_back( { blist_edit< T >::insert, pos[ i ], vals[ i ] } );
+                c.apply_batch( std::move( edits ) );
+            } );
+        if constexpr ( std::is_arithmetic_v< T > ) {
+            measure( name, elem, "parallel_reduce", n, n, none, [&]( int ) {
+                    sink = c.parallel_reduce( 0LL );
+                } );
+        }
+    }
+}
+
+template< typename T >
+static void bench_element( size_t n ) {
+    std::string t = type_name< T >();
+    bench_container< std::vector< T > >( "std::vector<" + t + ">", n );
+    bench_container< std::deque< T > >( "std::deque<" + t + ">", n );
+    bench_container< std::list< T > >( "std::list<" + t + ">", n );
+    bench_container< blist< T, 16, 16 > >( "blist<" + t + ", 16, 16>", n );
+    bench_container< blist< T, 128, 128 > >( "blist<" + t + ", 128, 128>", n );
+    bench_container< blist< T > >( "blist<" + t + ">", n );
+    bench_container< deque_blist< T > >( "deque_blist<" + t + ">", n );
+}
+
+// sorted containers: inserts of random keys into and lookups in a sorted
+// sequence of n elements
+template< typename C >
+static void bench_ordered( const std::string &name, size_t n ) {
+    using T = typename C::value_type;
+    const char *elem = type_name< T >();
+    std::mt19937_64 rng( 13 );
+    std::vector< T > vals( n );
+    for ( auto &v : vals )
+        v = make< T >( rng() % n );
+    auto add = []( C &c, const T &v ) {
+        if constexpr ( std::is_same_v< C, std::multiset< T > > )
+            c.insert( v );
+        else
+            c.insert_sorted( v );
+    };
+    auto filled = [&] {
+        C c;
+        for ( size_t i = 0; i < n; i += 2 )
+            add( c, vals[ i ] );
+        return c;
+    };
+
+    measure( name, elem, "insert_sorted", n / 2, n / 2, filled, [&]( C &c ) {
+            for ( size_t i = 1; i < n; i += 2 )
+                add( c, vals[ i ] );
+        } );
+    C c = filled();
+    measure( name, elem, "lower_bound", n / 2, n, [] { return 0; }, [&]( int ) {
+            long long sum = 0;
+            for ( auto &v : vals ) {
+                auto it = c.lower_bound( v );
+                sum += it == c.end() ? 0 : key( *it );
+            }
+            sink = sum;
+        } );
+}
+
+// static_vector and static_deque against std::vector of the same (small)
+// size, as used for the leaves: filling, and inserts and erases at random positions of a half
+// full vector
+template< typename T, size_t N >
+static void bench_small( size_t reps ) {
+    std::string t = type_name< T >();
+    std::vector< T > vals;
+    for ( size_t i = 0; i < N; ++i )
+        vals.push_back( make< T >( i ) );
+    std::mt19937_64 rng( 11 );
+    std::vector< size_t > pos( reps );
+    for ( auto &p : pos )
+        p = rng() % ( N / 2 );
+
+    auto run = [&]( auto tag, const std::string &name ) {
+        using C = typename decltype( tag )::type;
+        auto none = [] { return 0; };
+        measure( name, t.c_str(), "push_back", N, reps / 16 * N, none, [&]( int ) {
+                for ( size_t r = 0; r < reps / 16; ++r ) {
+                    C c;
+                    for ( auto &v : vals )
+                        c.push_back( v );
+                    sink = static_cast< long long >( c.size() );
+                }
+            } );
+        auto half = [&] { return C( vals.begin(), vals.begin() + N / 2 ); };
+        measure( name, t.c_str(), "insert+erase", N / 2, reps, half, [&]( C &c ) {
+                for ( size_t p : pos ) {
+                    c.insert( c.begin() + p, vals[ p ] );
+                    c.erase( c.begin() + ( p + 1 ) % c.size() );
+                }
+            } );
+    };
+    run( std::common_type< std::vector< T > >(), "std::vector<" + t + ">" );
+    run( std::common_type< static_vector< T, N > >(), "static_vector<" + t + ", " + std::to_string( N ) + ">" );
+    run( std::common_type< static_deque< T, N > >(), "static_deque<" + t + ", " + std::to_string( N ) + ">" );
+}
+
+template< typename T, uint32_t Leaf, uint32_t Fanout >
+static void sweep_one( size_t n, const std::vector< size_t > &idxs ) {
+    std::vector< T > vals;
+    for ( size_t i = 0; i < n; ++i )
+        vals.push_back( make< T >( i ) );
+    std::string name = "blist<" + std::string( type_name< T >() ) + ", " + std::to_string( Leaf ) +
+                       ", " + std::to_string( Fanout ) + ">";
+    using list = blist< T, Leaf, Fanout >;
+    auto none = [] { return 0; };
+    list bl( vals.begin(), vals.end() );
+
+    measure( name, type_name< T >(), "operator[]", n, idxs.size(), none, [&]( int ) {
+            long long sum = 0;
+            for ( size_t i : idxs )
+                sum += key( bl[ i % n ] );
+            sink = sum;
+        } );
+    measure( name, type_name< T >(), "scan_segmented", n, n, none, [&]( int ) {
+            sink = accumulate( bl.begin(), bl.end(), 0LL,
+                               []( long long a, const T &x ) { return a + key( x ); } );
+        } );
+    // random inserts grow the list by a tenth, leaves end up about 3/4 full
+    size_t ins = n / 10;
+    measure( name, type_name< T >(), "insert", n, ins, [&] { return list( vals.begin(), vals.end() ); },
+             [&]( list &l ) {
+            for ( size_t i = 0; i < ins; ++i )
+                l.insert( l.begin() + idxs[ i ] % ( l.size() + 1 ), vals[ i ] );
+        } );
+}
+
+// leaves of 256 B to 4 KiB with the default fanout, then fanouts of 8 to 128
+// with the default leaves
+template< typename T >
+static void sweep( size_t n, const std::vector< size_t > &idxs ) {
+    constexpr uint32_t f = blist_default_fanout;
+    constexpr auto leaf = []( size_t bytes ) { return uint32_t( std::max< size_t >( 4, bytes / sizeof( T ) / 2 * 2 ) ); };
+    sweep_one< T, leaf( 256 ), f >( n, idxs );
+    sweep_one< T, leaf( 512 ), f >( n, idxs );
+    sweep_one< T, leaf( 1024 ), f >( n, idxs );
+    sweep_one< T, leaf( 2048 ), f >( n, idxs );
+    sweep_one< T, leaf( 4096 ), f >( n, idxs );
+    constexpr uint32_t l = blist_default_leaf_capacity< T >;
+    sweep_one< T, l, 8 >( n, idxs );
+    sweep_one< T, l, 16 >( n, idxs );
+    sweep_one< T, l, 32 >( n, idxs );
+    sweep_one< T, l, 64 >( n, idxs );
+    sweep_one< T, l, 128 >( n, idxs );
+}
+
+static void print_json( const char *mode ) {
+    std::printf( "{\n  \"mode\": \"%s\",\n  \"threads\": %zu,\n", mode, thread_pool::global().size() );
+    std::printf( "  \"defaults\": { \"leaf_bytes\": %zu, \"fanout\": %u },\n", blist_leaf_bytes,
+                 blist_default_fanout );
+    std::printf( "  \"results\": [\n" );
+    for ( size_t i = 0; i < results.size(); ++i ) {
+        auto &r = results[ i ];
+        std::printf( "    { \"container\": \"%s\", \"element\": \"%s\", \"op\": \"%s\", "
+                     "\"size\": %zu, \"ns_per_op\": %.3f }%s\n",
+                     r.container.c_str(), r.element.c_str(), r.op.c_str(), r.size, r.ns_per_op,
+                     i + 1 < results.size() ? "," : "" );
+    }
+    std::printf( "  ]\n}\n" );
+}
+
+int main( int argc, char **argv ) {
+    if ( argc > 1 && std::string( argv[ 1 ] ) == "sweep" ) {
+        size_t n = argc > 2 ? std::strtoull( argv[ 2 ], nullptr, 10 ) : 2'000'000;
+        std::mt19937_64 rng( 42 );
+        std::vector< size_t > idxs( 2'000'000 );
+        for ( auto &i : idxs )
+            i = rng();
+        sweep< int >( n, idxs );
+        sweep< line >( n / 8, idxs );
+        print_json( "sweep" );
+        return 0;
+    }
+
+    size_t n = argc > 1 ? std::strtoull( argv[ 1 ], nullptr, 10 ) : 1'000'000;
+    bench_element< int >( n );
+    bench_element< line >( n / 8 );
+    bench_element< std::string >( n / 8 );
+    bench_ordered< std::multiset< int > >( "std::multiset<int>", n );
+    bench_ordered< ordered_blist< int > >( "ordered_blist<int>", n );
+    bench_small< int, 256 >( 100'000 );
+    bench_small< line, 32 >( 100'000 );
+    print_json( "compare" );
+}
@@ -1,19 +1,217 @@
+#pragma once
+
 // conditionally define assert so we can override it with RC_ASSERT for tests
 #ifndef assert
 #include <cassert>
 #endif
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <iterator>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <numeric>
+#include <optional>
+#include <tuple>
 #include <type_traits>
+#include <vector>
+#if defined( __AVX2__ ) || defined( __SSE4_2__ )
+#include <immintrin.h>
+#endif
 #include "static_vector.hpp"
+#include "static_deque.hpp"
+#include "thread_pool.hpp"
+#include "node_pool.hpp"
+
+// Monoids for the Monoid parameter of blist. A monoid has a value_type and
+// static functions identity(), lift( element ) and combine( a, b ), which has
+// to be associative (but not necessarily commutative) and must not throw.
+template< typename V >
+struct sum_monoid {
+    using value_type = V;
+    static V identity() { return V(); }
+    template< typename T >
+    static V lift( const T &x ) { return V( x ); }
+    static V combine( const V &a, const V &b ) { return a + b; }
+};
+
+template< typename V >
+struct min_monoid {
+    using value_type = V;
+    static V identity() { return std::numeric_limits< V >::max(); }
+    template< typename T >
+    static V lift( const T &x ) { return V( x ); }
+    static V combine( const V &a, const V &b ) { return b < a ? b : a; }
+};
+
+template< typename V >
+struct max_monoid {
+    using value_type = V;
+    static V identity() { return std::numeric_limits< V >::lowest(); }
+    template< typename T >
+    static V lift( const T &x ) { return V( x ); }
+    static V combine( const V &a, const V &b ) { return a < b ? b : a; }
+};
+
+// Monoid of ordered_blist, whose elements are kept sorted by Compare. The
+// greatest element of a subtree is then its last one, so combine keeps the
+// right operand and the aggregates are the maximum keys of the children
+// without comparing anything. identity() is only a left identity, which is
+// how blist uses it (the aggregates are folded from the left).
+template< typename T, typename Compare = std::less<> >
+struct max_key_monoid {
+    using value_type = T;
+    using key_compare = Compare;
+    static T identity() { return T(); }
+    template< typename U >
+    static T lift( const U &x ) { return T( x ); }
+    static T combine( const T &, const T &b ) { return b; }
+};
+
+// Shape of a blist as reported by blist::stats(). The occupancy histograms
+// count nodes by how full they are: bucket i holds the nodes filled to
+// [ i / buckets, ( i + 1 ) / buckets ) of their capacity, full nodes are in
+// the last bucket. bytes_used is the memory taken by the nodes, bytes_live
+// the part of it that holds elements.
+struct blist_stats {
+    static constexpr size_t buckets = 8;
+
+    size_t depth = 0;
+    size_t leaves = 0;
+    size_t internal_nodes = 0;
+    size_t leaf_occupancy[ buckets ] = {};
+    size_t internal_occupancy[ buckets ] = {};
+    size_t bytes_used = 0;
+    size_t bytes_live = 0;
+};
+
+// Structural operations done by a blist with Counters enabled, see
+// blist::counters(). A borrow moves entries between two neighbouring nodes
+// to fix an underfull one, a merge moves all entries of a node into its
+// neighbour and frees it.
+struct blist_counters {
+    size_t splits = 0;
+    size_t merges = 0;
+    size_t borrows = 0;
+    size_t allocations = 0;
+};
+
+// Edit for blist::apply_batch: inserts value before the element at pos, or
+// erases the element at pos (value is unused then). Positions refer to the
+// list as it was before the whole batch.
+template< typename T >
+struct blist_edit {
+    enum kind_type { insert, erase };
+
+    kind_type kind = insert;
+    size_t pos = 0;
+    T value = T();
+};
+
+// Cache geometry the default node capacities of blist are derived from.
+inline constexpr size_t blist_cache_line = 64;
+inline constexpr size_t blist_page_size = 4096;
+
+// Byte budgets of the default nodes. A leaf keeps its elements in half of
+// a page: positional lookups and scans get faster with longer leaves, while
+// inserts and erases shift half a leaf on average, which stops paying off
+// beyond a few KiB. An internal node keeps a child pointer and a prefix sum
+// for each child in 8 cache lines, so that a descent step touches a handful
+// of lines and is a few vector compares. `blist_bench sweep` times the
+// neighbouring budgets.
+inline constexpr size_t blist_leaf_bytes = blist_page_size / 2;
+inline constexpr size_t blist_internal_bytes = 8 * blist_cache_line;
 
-template< typename T, uint32_t NodeSize = 128 >
+// Number of elements of type T that fit into blist_leaf_bytes, rounded down
+// to an even number and at least 4 (large elements get leaves of 4).
+template< typename T >
+inline constexpr uint32_t blist_default_leaf_capacity =
+        std::max< uint32_t >( 4, blist_leaf_bytes / sizeof( T ) / 2 * 2 );
+
+inline constexpr uint32_t blist_default_fanout =
+        std::max< uint32_t >( 4, blist_internal_bytes / ( sizeof( void * ) + sizeof( size_t ) ) / 2 * 2 );
+
+// A sequence container implemented as a B+ tree. Elements are stored in leaves
+// (static_vectors of up to LeafCapacity elements), internal nodes keep pointers
+// to up to Fanout children together with the number of elements stored in each
+// child's subtree, which gives O(log n) indexing, insertion and removal. The
+// defaults fit the nodes into the byte budgets above.
+//
+// Invariants (checked by validate()):
+// - all leaves are at the same depth;
+// - every node except for the root is filled at least to the minimum fill,
+//   by default half of its capacity (min_leaf elements for leaves, min_fanout
+//   children for internal nodes, see set_min_fill()), the root holds at
+//   least two children if it is an internal node;
+// - an empty blist has no nodes at all;
+// - leaves are linked into a doubly-linked list in the order of elements.
+//
+// If Monoid is given (e.g. sum_monoid< long >), internal nodes also keep the
+// aggregate of every child's subtree next to its element count, which gives
+// range_query( from, to ) in O(log n). Elements of such a blist can then be
+// changed only through the member functions (e.g. modify()), the iterators,
+// references and segments give a read-only view. With max_key_monoid (see
+// ordered_blist) the aggregates are the maximum keys of the children and a
+// sorted list can be searched by key, see lower_bound().
+//
+// Nodes are allocated by Allocator rebound to the node types. Lists which
+// exchange nodes (split, concat, insert and erase of ranges) have to use
+// equal allocators, the same as std::list::splice. pmr_blist with a node_pool
+// keeps the nodes in slabs and recycles them through free lists, pooled_blist
+// owns such a pool and drops it in one call when it is destroyed.
+//
+// A Persistent blist (see persistent_blist) takes O(1) snapshots: nodes are
+// reference counted and shared with the snapshots, an operation that changes
+// the contents of a shared node copies it together with its ancestors first
+// (path copying), so snapshots cost memory proportional to the edits made
+// after them. Parent pointers and leaf links of shared nodes describe only
+// the live list, snapshots traverse the tree from the root. As in augmented
+// lists, elements are read-only through iterators and references.
+//
+// With Counters, the list counts its node splits, merges, borrows and
+// allocations (see counters()). Without them, the counting compiles away.
+//
+// LeafStorage is the container of the elements of a leaf, static_vector or
+// static_deque (see deque_blist). A static_deque leaf takes inserts and
+// erases at its front without shifting the whole leaf, in exchange its
+// elements are not contiguous: segments are ranges of static_deque
+// iterators and for_each_segment can call f twice for one leaf.
+template< typename T, uint32_t LeafCapacity = blist_default_leaf_capacity< T >,
+          uint32_t Fanout = blist_default_fanout, typename Monoid = void,
+          typename Allocator = std::allocator< T >, bool Persistent = false,
+          bool Counters = false, template< typename, size_t > class LeafStorage = static_vector >
 class blist
 {
-    static_assert( NodeSize >= 4, "node size must be at least 4 elements" );
-    static_assert( NodeSize % 2 == 0, "node size must be an even number" );
-    static constexpr size_t node_size = NodeSize;
-    static constexpr size_t half_size = node_size / 2;
+    static_assert( LeafCapacity >= 4, "leaf capacity must be at least 4 elements" );
+    static_assert( LeafCapacity % 2 == 0, "leaf capacity must be an even number" );
+    static_assert( Fanout >= 4, "fanout must be at least 4 children" );
+    static_assert( Fanout % 2 == 0, "fanout must be an even number" );
+    static constexpr bool augmented = !std::is_void_v< Monoid >;
+    static constexpr bool persistent = Persistent;
+    static constexpr bool counted = Counters;
+    using leaf_storage = LeafStorage< T, LeafCapacity >;
+    static constexpr bool contiguous_leaves = std::is_pointer_v< typename leaf_storage::iterator >;
+    static constexpr size_t leaf_size = LeafCapacity;
+    static constexpr size_t fanout = Fanout;
+    static constexpr size_t min_leaf = leaf_size / 2;
+    static constexpr size_t min_fanout = fanout / 2;
+
+    // Number of entries bulk loading puts into each node. Nodes are not packed
+    // full so that inserts that follow the construction do not split a node
+    // immediately.
+    static constexpr size_t leaf_fill = leaf_size - leaf_size / 4;
+    static constexpr size_t fanout_fill = fanout - fanout / 4;
+
+    // How much of the following leaf is prefetched when an iterator enters
+    // a leaf, so that scans do not stall on the leaf boundaries.
+    static constexpr size_t prefetch_bytes = 256;
+
+    // The parallel algorithms never create tasks of less elements than this.
+    static constexpr size_t parallel_min_grain = 4096;
 
-    // **suggested**
     // Can be used to set one type to const if the other type is const.
     // CopyConst< const int, long > == const long
     // CopyConst< int, long > = long
@@ -28,97 +226,3304 @@ class blist
     template< typename From, typename To >
     using CopyConst = std::conditional_t< std::is_const_v< From >, const To, To >;
 
-    // **suggested**
-    // We suggest that you define the iterator using this templated class which
-    // will be instantiated to either non-const or const tree node to get you
-    // const or non-const iterator.
+    // type of the elements as seen through iterators into Node
+    template< typename Node >
+    using Element = std::conditional_t< augmented || persistent, const T, CopyConst< Node, T > >;
+
+    // iterator into the data of Node giving access to Element< Node >
+    template< typename Node >
+    using LeafIterator = std::conditional_t< std::is_const_v< Element< Node > >,
+                                             typename leaf_storage::const_iterator,
+                                             typename leaf_storage::iterator >;
+
+    // aggs[ i ] is the aggregate of the subtree of children[ i ]
+    template< typename M, typename = void >
+    struct aggregates { };
+
+    template< typename M >
+    struct aggregates< M, std::enable_if_t< !std::is_void_v< M > > > {
+        static_vector< typename M::value_type, Fanout > aggs;
+    };
+
+    // type of the aggregates, an empty placeholder if there is no monoid
+    template< typename M, typename = void >
+    struct aggregate_value { using type = std::tuple<>; };
+
+    template< typename M >
+    struct aggregate_value< M, std::enable_if_t< !std::is_void_v< M > > > {
+        using type = typename M::value_type;
+    };
+
+    // least numbers of entries of the nodes other than the root, see
+    // set_min_fill()
+    struct fill_bounds {
+        size_t leaf = min_leaf;
+        size_t internal = min_fanout;
+    };
+
+    template< typename V, typename = void >
+    struct is_comparable : std::false_type { };
+
+    template< typename V >
+    struct is_comparable< V, std::void_t< decltype( std::declval< const V & >() == std::declval< const V & >() ) > >
+        : std::true_type { };
+
+    // number of owners of a node: the parent or the list for the root, and
+    // the snapshots sharing it as their root
+    template< bool Counted, typename = void >
+    struct node_refs { };
+
+    template< typename V >
+    struct node_refs< true, V > {
+        std::atomic< uint32_t > refs{ 1 };
+    };
+
+    struct internal_node;
+
+    struct node_base : node_refs< persistent > {
+        explicit node_base( bool leaf ) noexcept : leaf( leaf ) { }
+
+        internal_node *parent = nullptr;
+        const bool leaf;
+    };
+
+    struct leaf_node : node_base {
+        leaf_node() noexcept : node_base( true ) { }
+
+        leaf_node *prev = nullptr;
+        leaf_node *next = nullptr;
+        leaf_storage data;
+    };
+
+    // Element counts of the children of an internal node, stored as prefix
+    // sums in their own cache-line-aligned array apart from the child
+    // pointers. The child holding a position is the number of sums not
+    // greater than the position, which is counted by a branchless loop over
+    // whole SIMD vectors (AVX2 or SSE4.2 if enabled, scalar otherwise).
+    // Unused slots hold a sentinel greater than any position. The sums are
+    // stored less a common offset, so that a change of the first child's
+    // count (a prepend) updates the offset only, compared as signed values.
+    class child_counts
+    {
+        static constexpr size_t sentinel = std::numeric_limits< ptrdiff_t >::max();
+
+        alignas( 64 ) size_t _sums[ Fanout ];
+        uint32_t _size = 0;
+        ptrdiff_t _offset = 0;
+
+        size_t _sum( size_t i ) const noexcept { return _sums[ i ] + _offset; }
+
+        // adds the offset to the stored sums, before they are moved around
+        void _normalize() noexcept {
+            for ( size_t i = 0; i < _size; ++i )
+                _sums[ i ] += _offset;
+            _offset = 0;
+        }
+
+      public:
+        child_counts() noexcept { std::fill( _sums, _sums + Fanout, sentinel ); }
+
+        size_t size() const noexcept { return _size; }
+
+        // number of elements in the subtree of the i-th child
+        size_t operator[]( size_t i ) const noexcept { return _sum( i ) - before( i ); }
+
+        // number of elements in the subtrees of children [0, i)
+        size_t before( size_t i ) const noexcept { return i ? _sum( i - 1 ) : 0; }
+
+        size_t total() const noexcept { return before( _size ); }
+
+        // adds delta to the count of the i-th child
+        void add( size_t i, ptrdiff_t delta ) noexcept {
+            if ( i == 0 ) {
+                _offset += delta;
+                return;
+            }
+            for ( ; i < _size; ++i )
+                _sums[ i ] += delta;
+        }
+
+        // moves delta elements from the (i + 1)-th child to the i-th one
+        void shift( size_t i, ptrdiff_t delta ) noexcept { _sums[ i ] += delta; }
+
+        void push_back( size_t cnt ) noexcept { insert( _size, cnt ); }
+        void insert( size_t i, size_t cnt ) noexcept { insert( i, &cnt, &cnt + 1 ); }
+
+        // inserts the counts [first, last) before the i-th child
+        void insert( size_t i, const size_t *first, const size_t *last ) noexcept {
+            size_t k = last - first;
+            assert( _size + k <= Fanout );
+            _normalize();
+            std::copy_backward( _sums + i, _sums + _size, _sums + _size + k );
+            size_t base = before( i );
+            size_t sum = base;
+            for ( size_t j = 0; j < k; ++j )
+                _sums[ i + j ] = sum += first[ j ];
+            _size += k;
+            add( i + k, sum - base );
+        }
+
+        // removes the counts of children [from, to)
+        void erase( size_t from, size_t to ) noexcept {
+            _normalize();
+            size_t removed = before( to ) - before( from );
+            for ( size_t j = to; j < _size; ++j )
+                _sums[ j - ( to - from ) ] = _sums[ j ] - removed;
+            std::fill( _sums + _size - ( to - from ), _sums + _size, sentinel );
+            _size -= to - from;
+        }
+
+        void clear() noexcept { erase( 0, _size ); }
+
+        // index of the child holding the idx-th element, idx < total()
+        size_t find( size_t idx ) const noexcept {
+            assert( idx < total() );
+            // the stored sums are compared with idx less the offset
+            const ptrdiff_t key = ptrdiff_t( idx ) - _offset;
+            size_t i = 0;
+            size_t cnt = 0;
+#if defined( __AVX2__ )
+            // a lane of acc is decremented by the all ones mask of every sum <= key
+            const __m256i x = _mm256_set1_epi64x( static_cast< long long >( key + 1 ) );
+            __m256i acc = _mm256_setzero_si256();
+            for ( ; i + 4 <= Fanout && i < _size; i += 4 ) {
+                __m256i sums = _mm256_load_si256( reinterpret_cast< const __m256i * >( _sums + i ) ); // NOLINT
+                acc = _mm256_sub_epi64( acc, _mm256_cmpgt_epi64( x, sums ) );
+            }
+            __m128i half = _mm_add_epi64( _mm256_castsi256_si128( acc ), _mm256_extracti128_si256( acc, 1 ) );
+            cnt = _mm_cvtsi128_si64( half ) + _mm_extract_epi64( half, 1 );
+#elif defined( __SSE4_2__ )
+            const __m128i x = _mm_set1_epi64x( static_cast< long long >( key + 1 ) );
+            __m128i acc = _mm_setzero_si128();
+            for ( ; i + 2 <= Fanout && i < _size; i += 2 ) {
+                __m128i sums = _mm_load_si128( reinterpret_cast< const __m128i * >( _sums + i ) ); // NOLINT
+                acc = _mm_sub_epi64( acc, _mm_cmpgt_epi64( x, sums ) );
+            }
+            cnt = _mm_cvtsi128_si64( acc ) + _mm_extract_epi64( acc, 1 );
+#endif
+            for ( ; i < Fanout && i < _size; ++i )
+                cnt += ptrdiff_t( _sums[ i ] ) <= key;
+            return cnt;
+        }
+    };
+
+    struct internal_node : node_base, aggregates< Monoid > {
+        internal_node() noexcept : node_base( false ) { }
+
+        static_vector< node_base *, Fanout > children;
+        child_counts counts;
+    };
+
+    struct node_deleter {
+        const Allocator *alloc;
+        void operator()( node_base *n ) const noexcept { _free_node( n, *alloc ); }
+    };
+    using node_ptr = std::unique_ptr< node_base, node_deleter >;
+
+    // subtree taken out of the tree while apply_batch rebuilds its parent,
+    // together with its aggregate so that untouched subtrees keep theirs
+    struct subtree {
+        node_ptr node;
+        typename aggregate_value< Monoid >::type agg;
+    };
+
+    // Moves elements into new leaves of list: n elements in total, spread
+    // evenly over the leaves so that they hold about fill elements each.
+    // finish() then builds the tree over the leaves, the list must not
+    // have a tree until then.
+    class leaf_sink {
+        blist &_list;
+        size_t _n, _k;
+        size_t _room = 0; // elements the last leaf still takes
+        std::vector< node_ptr > _level;
+
+      public:
+        leaf_sink( blist &list, size_t n, size_t fill )
+            : _list( list ), _n( n ), _k( _chunks( n, fill, list._min.leaf ) )
+        {
+            _level.reserve( _k );
+        }
+
+        void push( T &&x ) {
+            if ( _room == 0 ) {
+                _room = _chunk_size( _n, _k, _level.size() );
+                _level.push_back( _list._own( _list._new_leaf() ) );
+            }
+            _as_leaf( _level.back().get() )->data.emplace_back( std::move( x ) );
+            --_room;
+        }
+
+        // the leaves filled so far, for _restore()
+        std::vector< node_ptr > &leaves() noexcept { return _level; }
+
+        // builds the internal levels filled to about fill children each
+        void finish( size_t fill ) {
+            assert( _level.size() == _k && _room == 0 );
+            _list._build_tree( _level, fill );
+        }
+    };
+
+    // Node is either leaf_node or const leaf_node, giving iterator and
+    // const_iterator respectively. The iterator points to an element inside
+    // a leaf, the end iterator points one past the last element of the last
+    // leaf. An iterator never points past the end of any other leaf.
+    //
+    // The iterator is random access: jumps that leave the current leaf climb
+    // only as high as needed to find the target and descend using the element
+    // counts in the internal nodes, distances are computed from the positions
+    // of both iterators, so both take O(log n).
+    template< typename Node >
+    class base_iterator
+    {
+        friend class blist;
+        template< typename > friend class base_iterator;
+
+        Node *_leaf = nullptr;
+        size_t _idx = 0;
+
+        base_iterator( Node *leaf, size_t idx ) noexcept : _leaf( leaf ), _idx( idx ) { }
+
+      public:
+        using value_type = T;
+        using difference_type = ptrdiff_t;
+        using reference = Element< Node > &;
+        using pointer = Element< Node > *;
+        using iterator_category = std::random_access_iterator_tag;
+
+        base_iterator() noexcept = default;
+
+        // iterator -> const_iterator conversion
+        template< typename N, typename = std::enable_if_t< std::is_same_v< const N, Node >
+                                                           && !std::is_same_v< N, Node > > >
+        base_iterator( const base_iterator< N > &o ) noexcept // NOLINT
+            : _leaf( o._leaf ), _idx( o._idx )
+        { }
+
+        reference operator*() const { return _leaf->data[ _idx ]; }
+        pointer operator->() const { return &_leaf->data[ _idx ]; }
+
+        base_iterator &operator++() {
+            if ( ++_idx == _leaf->data.size() && _leaf->next ) {
+                _leaf = _leaf->next;
+                _idx = 0;
+                _prefetch( _leaf->next );
+            }
+            return *this;
+        }
+
+        base_iterator operator++( int ) {
+            auto copy = *this;
+            ++*this;
+            return copy;
+        }
+
+        base_iterator &operator--() {
+            if ( _idx == 0 ) {
+                _leaf = _leaf->prev;
+                _idx = _leaf->data.size();
+                _prefetch( _leaf->prev );
+            }
+            --_idx;
+            return *this;
+        }
+
+        base_iterator operator--( int ) {
+            auto copy = *this;
+            --*this;
+            return copy;
+        }
+
+        base_iterator &operator+=( difference_type n ) {
+            std::tie( _leaf, _idx ) = _advance( _leaf, _idx, n );
+            return *this;
+        }
+
+        base_iterator &operator-=( difference_type n ) { return *this += -n; }
+
+        base_iterator operator+( difference_type n ) const { return base_iterator( *this ) += n; }
+        base_iterator operator-( difference_type n ) const { return base_iterator( *this ) -= n; }
+        friend base_iterator operator+( difference_type n, const base_iterator &it ) { return it + n; }
+
+        template< typename N >
+        difference_type operator-( const base_iterator< N > &o ) const noexcept {
+            if ( _leaf == o._leaf )
+                return difference_type( _idx ) - difference_type( o._idx );
+            return difference_type( _position() ) - difference_type( o._position() );
+        }
+
+        reference operator[]( difference_type n ) const { return *(*this + n); }
+
+        template< typename N >
+        bool operator==( const base_iterator< N > &o ) const noexcept {
+            return _leaf == o._leaf && _idx == o._idx;
+        }
+
+        template< typename N >
+        bool operator!=( const base_iterator< N > &o ) const noexcept { return !(*this == o); }
+
+        template< typename N >
+        bool operator<( const base_iterator< N > &o ) const noexcept { return *this - o < 0; }
+        template< typename N >
+        bool operator>( const base_iterator< N > &o ) const noexcept { return o < *this; }
+        template< typename N >
+        bool operator<=( const base_iterator< N > &o ) const noexcept { return !(o < *this); }
+        template< typename N >
+        bool operator>=( const base_iterator< N > &o ) const noexcept { return !(*this < o); }
+
+      private:
+        size_t _position() const noexcept { return _leaf ? _index_of( _leaf, _idx ) : 0; }
+    };
+
+    // Run of elements stored in a single leaf, contiguous unless the leaves
+    // are static_deques.
+    template< typename Ptr >
+    class basic_segment
+    {
+        Ptr _first;
+        Ptr _last;
+
+      public:
+        basic_segment( Ptr first, Ptr last ) noexcept : _first( first ), _last( last ) { }
+
+        Ptr begin() const noexcept { return _first; }
+        Ptr end() const noexcept { return _last; }
+        Ptr data() const noexcept { return _first; }
+        size_t size() const noexcept { return _last - _first; }
+        bool empty() const noexcept { return _first == _last; }
+    };
+
+    // Iterates over the leaves, yielding each one as a segment.
+    template< typename Node >
+    class base_segment_iterator
+    {
+        friend class blist;
+
+        Node *_leaf = nullptr;
+
+        explicit base_segment_iterator( Node *leaf ) noexcept : _leaf( leaf ) { }
+
+      public:
+        using value_type = basic_segment< LeafIterator< Node > >;
+        using difference_type = ptrdiff_t;
+        using reference = value_type;
+        using pointer = void;
+        using iterator_category = std::forward_iterator_tag;
+
+        base_segment_iterator() noexcept = default;
+
+        value_type operator*() const noexcept {
+            return value_type( _leaf->data.begin(), _leaf->data.end() );
+        }
+
+        base_segment_iterator &operator++() noexcept {
+            _leaf = _leaf->next;
+            if ( _leaf )
+                _prefetch( _leaf->next );
+            return *this;
+        }
+
+        base_segment_iterator operator++( int ) noexcept {
+            auto copy = *this;
+            ++*this;
+            return copy;
+        }
+
+        bool operator==( const base_segment_iterator &o ) const noexcept { return _leaf == o._leaf; }
+        bool operator!=( const base_segment_iterator &o ) const noexcept { return _leaf != o._leaf; }
+    };
+
     template< typename Node >
-    class base_iterator;
+    struct base_segment_range {
+        base_segment_iterator< Node > first;
+
+        base_segment_iterator< Node > begin() const noexcept { return first; }
+        base_segment_iterator< Node > end() const noexcept { return {}; }
+    };
+
+    // Read-only view of a persistent list as it was when the snapshot was
+    // taken. The view shares the nodes with the list and with its copies,
+    // copying it takes O(1). Parent pointers and leaf links belong to the
+    // live list, so the iterators find their leaves from the root instead.
+    class snapshot_view
+    {
+        friend class blist;
+
+        node_base *_root = nullptr;
+        size_t _size = 0;
+        // optional, because polymorphic_allocator cannot be assigned
+        std::optional< Allocator > _alloc;
+
+        snapshot_view( node_base *root, size_t size, const Allocator &alloc ) noexcept
+            : _root( _acquire( root ) ), _size( size ), _alloc( alloc )
+        { }
+
+      public:
+        class const_iterator
+        {
+            friend class snapshot_view;
+
+            const node_base *_root = nullptr;
+            const leaf_node *_leaf = nullptr;
+            size_t _size = 0;
+            size_t _pos = 0;
+            size_t _first = 0; // position of the first element of _leaf
+
+            const_iterator( const node_base *root, size_t size, size_t pos ) noexcept
+                : _root( root ), _size( size ), _pos( pos )
+            {
+                _seek();
+            }
+
+          public:
+            using value_type = T;
+            using difference_type = ptrdiff_t;
+            using reference = const T &;
+            using pointer = const T *;
+            using iterator_category = std::random_access_iterator_tag;
+
+            const_iterator() noexcept = default;
+
+            reference operator*() const { return _leaf->data[ _pos - _first ]; }
+            pointer operator->() const { return &**this; }
+
+            const_iterator &operator++() {
+                if ( ++_pos - _first == _leaf->data.size() )
+                    _seek();
+                return *this;
+            }
+
+            const_iterator operator++( int ) {
+                auto copy = *this;
+                ++*this;
+                return copy;
+            }
+
+            const_iterator &operator--() {
+                if ( _pos-- == _first )
+                    _seek();
+                return *this;
+            }
+
+            const_iterator operator--( int ) {
+                auto copy = *this;
+                --*this;
+                return copy;
+            }
+
+            const_iterator &operator+=( difference_type n ) {
+                _pos += n;
+                if ( !_leaf || _pos < _first || _pos - _first >= _leaf->data.size() )
+                    _seek();
+                return *this;
+            }
+
+            const_iterator &operator-=( difference_type n ) { return *this += -n; }
+
+            const_iterator operator+( difference_type n ) const { return const_iterator( *this ) += n; }
+            const_iterator operator-( difference_type n ) const { return const_iterator( *this ) -= n; }
+            friend const_iterator operator+( difference_type n, const const_iterator &it ) { return it + n; }
+
+            difference_type operator-( const const_iterator &o ) const noexcept {
+                return difference_type( _pos ) - difference_type( o._pos );
+            }
+
+            reference operator[]( difference_type n ) const { return *(*this + n); }
+
+            bool operator==( const const_iterator &o ) const noexcept { return _pos == o._pos; }
+            bool operator!=( const const_iterator &o ) const noexcept { return _pos != o._pos; }
+            bool operator<( const const_iterator &o ) const noexcept { return _pos < o._pos; }
+            bool operator>( const const_iterator &o ) const noexcept { return _pos > o._pos; }
+            bool operator<=( const const_iterator &o ) const noexcept { return _pos <= o._pos; }
+            bool operator>=( const const_iterator &o ) const noexcept { return _pos >= o._pos; }
+
+          private:
+            void _seek() noexcept {
+                if ( _pos >= _size ) {
+                    _leaf = nullptr;
+                    _first = _pos;
+                    return;
+                }
+                auto [ leaf, idx ] = _descend( _root, _pos );
+                _leaf = leaf;
+                _first = _pos - idx;
+            }
+        };
+
+        using iterator = const_iterator;
+
+        snapshot_view() noexcept = default;
+
+        snapshot_view( const snapshot_view &o ) noexcept
+            : _root( _acquire( o._root ) ), _size( o._size ), _alloc( o._alloc )
+        { }
+
+        snapshot_view( snapshot_view &&o ) noexcept
+            : _root( std::exchange( o._root, nullptr ) ), _size( std::exchange( o._size, 0 ) ),
+              _alloc( o._alloc )
+        { }
+
+        ~snapshot_view() { _release(); }
+
+        snapshot_view &operator=( const snapshot_view &o ) noexcept {
+            if ( &o != this ) {
+                _release();
+                _root = _acquire( o._root );
+                _size = o._size;
+                _assign_alloc( o );
+            }
+            return *this;
+        }
+
+        snapshot_view &operator=( snapshot_view &&o ) noexcept {
+            if ( &o != this ) {
+                _release();
+                _root = std::exchange( o._root, nullptr );
+                _size = std::exchange( o._size, 0 );
+                _assign_alloc( o );
+            }
+            return *this;
+        }
+
+        bool empty() const noexcept { return _size == 0; }
+        size_t size() const noexcept { return _size; }
+
+        const T &operator[]( size_t idx ) const {
+            auto [ leaf, i ] = _descend( static_cast< const node_base * >( _root ), idx );
+            return leaf->data[ i ];
+        }
+
+        const_iterator begin() const noexcept { return const_iterator( _root, _size, 0 ); }
+        const_iterator end() const noexcept { return const_iterator( _root, _size, _size ); }
+        const_iterator cbegin() const noexcept { return begin(); }
+        const_iterator cend() const noexcept { return end(); }
+
+        // calls f( first, last ) with pointers delimiting the elements of every leaf
+        template< typename F >
+        void for_each_segment( F &&f ) const {
+            if ( _root )
+                _visit( _root, f );
+        }
+
+        template< typename M = Monoid >
+        typename M::value_type range_query( size_t from, size_t to ) const {
+            assert( from <= to && to <= _size );
+            if ( from == to )
+                return Monoid::identity();
+            return _query( _root, from, to );
+        }
+
+      private:
+        // a default constructed view has no allocator
+        void _assign_alloc( const snapshot_view &o ) noexcept {
+            if ( o._alloc )
+                _alloc.emplace( *o._alloc );
+            else
+                _alloc.reset();
+        }
+
+        void _release() noexcept {
+            if ( _root )
+                _free_node( std::exchange( _root, nullptr ), *_alloc );
+            _size = 0;
+        }
+
+        template< typename F >
+        static void _visit( const node_base *n, F &f ) {
+            if ( n->leaf ) {
+                auto &data = _as_leaf( n )->data;
+                _spans( data, 0, data.size(), f );
+                return;
+            }
+            for ( const node_base *c : _as_internal( n )->children )
+                _visit( c, f );
+        }
+    };
+
+    // Position in a list for a run of edits close to each other, such as
+    // typing into a text buffer. Inserts and erases through the cursor which
+    // neither split nor underfill its leaf change only the leaf; the changes
+    // of the element count are summed up and applied to the ancestors (and
+    // their aggregates, if the list is augmented) along the stored path from
+    // the root when the cursor leaves the leaf, on commit() or by the
+    // destructor. A run of edits in one leaf thus takes O(1) per edit
+    // instead of O(log n).
+    //
+    // While a cursor holds uncommitted edits, the counts in the tree are
+    // stale and the list must be used only through the cursor, size() is
+    // the exception. A change of the list not made through the cursor
+    // invalidates it, like it invalidates iterators.
+    class list_cursor
+    {
+        friend class blist;
+        using iterator = base_iterator< leaf_node >;
+
+        blist *_list = nullptr;
+        leaf_node *_leaf = nullptr;
+        size_t _idx = 0;
+        ptrdiff_t _delta = 0; // change of the element count of _leaf not applied yet
+        bool _dirty = false;  // _leaf was changed since the last commit
+        // ancestors of _leaf with the index of the child on the path to it,
+        // from the parent up, computed by the first commit in the leaf
+        static_vector< std::pair< internal_node *, size_t >, 64 > _path;
+
+        list_cursor( blist *list, iterator pos ) noexcept : _list( list ) { _seat( pos ); }
+
+      public:
+        using value_type = T;
+        using reference = Element< leaf_node > &;
+        using pointer = Element< leaf_node > *;
+
+        list_cursor() noexcept = default;
+
+        list_cursor( list_cursor &&o ) noexcept
+            : _list( o._list ), _leaf( o._leaf ), _idx( o._idx ), _delta( std::exchange( o._delta, 0 ) ),
+              _dirty( std::exchange( o._dirty, false ) ), _path( std::move( o._path ) )
+        { }
+
+        list_cursor &operator=( list_cursor &&o ) noexcept {
+            if ( &o != this ) {
+                commit();
+                _list = o._list;
+                _leaf = o._leaf;
+                _idx = o._idx;
+                _delta = std::exchange( o._delta, 0 );
+                _dirty = std::exchange( o._dirty, false );
+                _path = std::move( o._path );
+            }
+            return *this;
+        }
+
+        list_cursor( const list_cursor & ) = delete;
+        list_cursor &operator=( const list_cursor & ) = delete;
+
+        ~list_cursor() { commit(); }
+
+        reference operator*() const { return _leaf->data[ _idx ]; }
+        pointer operator->() const { return &_leaf->data[ _idx ]; }
+
+        bool at_end() const noexcept { return !_leaf || _idx == _leaf->data.size(); }
+
+        // position of the cursor in the list, O(log n)
+        size_t index() const noexcept { return _leaf ? _index_of( _leaf, _idx ) : 0; }
+
+        // iterator to the element under the cursor, the edits are committed
+        iterator position() noexcept {
+            commit();
+            return iterator( _leaf, _idx );
+        }
+
+        list_cursor &operator++() {
+            if ( ++_idx == _leaf->data.size() && _leaf->next )
+                _enter( _leaf->next, 0 );
+            return *this;
+        }
+
+        list_cursor &operator--() {
+            if ( _idx == 0 )
+                _enter( _leaf->prev, _leaf->prev->data.size() - 1 );
+            else
+                --_idx;
+            return *this;
+        }
+
+        list_cursor &operator+=( ptrdiff_t n ) {
+            if ( !_leaf ) {
+                assert( n == 0 );
+                return *this;
+            }
+            ptrdiff_t idx = ptrdiff_t( _idx ) + n;
+            if ( idx >= 0 && ( size_t( idx ) < _leaf->data.size() || !_leaf->next ) ) {
+                assert( size_t( idx ) <= _leaf->data.size() );
+                _idx = idx;
+                return *this;
+            }
+            commit();
+            _path.clear();
+            _seat( iterator( _leaf, _idx ) + n );
+            return *this;
+        }
+
+        list_cursor &operator-=( ptrdiff_t n ) { return *this += -n; }
+
+        // Inserts a new element before the cursor, which keeps pointing to
+        // the same element (or the end).
+        template< typename... Args >
+        void emplace( Args &&...args ) {
+            if ( _leaf && !_leaf->data.full() ) {
+                _touch();
+                _leaf->data.emplace( _leaf->data.begin() + _idx, std::forward< Args >( args )... );
+                ++_idx;
+                ++_delta;
+                ++_list->_size;
+                return;
+            }
+            commit();
+            _path.clear();
+            auto it = _list->emplace( iterator( _leaf, _idx ), std::forward< Args >( args )... );
+            _seat( iterator( it._leaf, it._idx + 1 ) );
+        }
+
+        void insert( const T &value ) { emplace( value ); }
+        void insert( T &&value ) { emplace( std::move( value ) ); }
+
+        // Removes the element under the cursor, the cursor moves to the
+        // following one.
+        void erase() {
+            assert( !at_end() );
+            if ( _leaf == _list->_root ? _list->_size > 1 : _leaf->data.size() > _list->_min.leaf ) {
+                _touch();
+                _leaf->data.erase( _leaf->data.begin() + _idx );
+                --_delta;
+                --_list->_size;
+                if ( _idx == _leaf->data.size() && _leaf->next )
+                    _enter( _leaf->next, 0 );
+                return;
+            }
+            commit();
+            _path.clear();
+            _seat( _list->erase( iterator( _leaf, _idx ) ) );
+        }
+
+        // Applies the edits made in the current leaf to its ancestors.
+        void commit() noexcept {
+            if ( !_dirty )
+                return;
+            if ( _path.empty() ) {
+                const node_base *n = _leaf;
+                for ( internal_node *p = n->parent; p; n = p, p = p->parent )
+                    _path.emplace_back( p, _child_index( p, n ) );
+            }
+            for ( auto [ p, i ] : _path ) {
+                p->counts.add( i, _delta );
+                _update( p, i );
+            }
+            _delta = 0;
+            _dirty = false;
+        }
+
+      private:
+        // moves to the position of it, the edits must have been committed
+        void _seat( iterator it ) noexcept {
+            _leaf = it._leaf;
+            _idx = it._idx;
+            if ( _leaf && _idx == _leaf->data.size() && _leaf->next ) {
+                _leaf = _leaf->next;
+                _idx = 0;
+            }
+        }
+
+        void _enter( leaf_node *leaf, size_t idx ) noexcept {
+            commit();
+            _path.clear();
+            _leaf = leaf;
+            _idx = idx;
+        }
+
+        // prepares the leaf for a change, a shared leaf of a persistent list
+        // is copied together with its ancestors first
+        void _touch() {
+            if ( _dirty )
+                return;
+            if constexpr ( persistent ) {
+                auto it = _list->_unshare_path( iterator( _leaf, _idx ) );
+                if ( it._leaf != _leaf )
+                    _path.clear();
+                _leaf = it._leaf;
+            }
+            _dirty = true;
+        }
+    };
 
   public:
     using value_type = T;
-    using reference = T &;
+    using size_type = size_t;
+    using difference_type = ptrdiff_t;
+    using reference = Element< leaf_node > &;
     using const_reference = const T &;
-    using pointer = T *;
+    using pointer = Element< leaf_node > *;
     using const_pointer = const T *;
-    using iterator = base_iterator< /* ... */ >; // **suggested implementation**
-    using const_iterator = base_iterator< const /* ... */ >; // **suggested implementation**
+    using allocator_type = Allocator;
+    using iterator = base_iterator< leaf_node >;
+    using const_iterator = base_iterator< const leaf_node >;
     using reverse_iterator = std::reverse_iterator< iterator >;
     using const_reverse_iterator = std::reverse_iterator< const_iterator >;
+    using segment = basic_segment< LeafIterator< leaf_node > >;
+    using const_segment = basic_segment< LeafIterator< const leaf_node > >;
+    using segment_range = base_segment_range< leaf_node >;
+    using const_segment_range = base_segment_range< const leaf_node >;
+    using snapshot_type = snapshot_view;
+    using cursor = list_cursor;
+    using edit = blist_edit< T >;
+
+    blist() noexcept( noexcept( Allocator() ) ) = default;
+
+    explicit blist( const Allocator &alloc ) noexcept : _alloc( alloc ) { }
 
-    // **required: define these constructors & assignment operators as needed,
-    // they can (and should) be omitted or defaulted if that results in a
-    // correct implementation (do not re-implement what compiler can do for you)
-    blist();
-    blist( blist && );
-    blist( const blist &o );
+    blist( blist &&o ) noexcept
+        : _root( std::exchange( o._root, nullptr ) ), _size( std::exchange( o._size, 0 ) ),
+          _alloc( std::move( o._alloc ) ), _first( std::exchange( o._first, nullptr ) ),
+          _last( std::exchange( o._last, nullptr ) ), _min( o._min )
+    { }
 
+    // moves the nodes of o if the allocators are equal, the elements otherwise
+    blist( blist &&o, const Allocator &alloc ) : _alloc( alloc ), _min( o._min ) {
+        if ( _alloc == o._alloc ) {
+            _root = std::exchange( o._root, nullptr );
+            _size = std::exchange( o._size, 0 );
+            _first = std::exchange( o._first, nullptr );
+            _last = std::exchange( o._last, nullptr );
+        } else
+            _bulk_load( std::make_move_iterator( o.begin() ), std::make_move_iterator( o.end() ) );
+    }
+
+    // Copies the elements in O(n), persistent lists included: the leaf links
+    // and parent pointers of a node describe a single live list, so two
+    // lists cannot share nodes. snapshot() is the O(1) copy, a read-only one.
+    blist( const blist &o )
+        : blist( o.begin(), o.end(), alloc_traits::select_on_container_copy_construction( o._alloc ) )
+    {
+        _min = o._min;
+    }
+
+    blist( const blist &o, const Allocator &alloc ) : blist( o.begin(), o.end(), alloc ) { _min = o._min; }
+
+    // Builds the tree bottom-up in linear time: leaves are filled to
+    // leaf_fill elements and internal levels are then stacked on top of them.
+    // If It is at least a forward iterator, the shape of the tree is computed
+    // in advance from the length of the range, single-pass ranges are
+    // consumed leaf by leaf and only the last two leaves are rebalanced.
     // note: this constructor can be called only if It is an iterator as seen by C++ <= 17
     template< typename It, typename = typename std::iterator_traits< It >::value_type >
-    blist( It first, It last );
+    blist( It first, It last, const Allocator &alloc = Allocator() ) : _alloc( alloc ) {
+        _bulk_load( first, last );
+    }
 
-    blist( std::initializer_list< T > ilist );
+    blist( std::initializer_list< T > ilist, const Allocator &alloc = Allocator() )
+        : blist( ilist.begin(), ilist.end(), alloc )
+    { }
 
-    blist &operator=( blist && );
-    blist &operator=( const blist &o );
+    // A list which is the only owner of its pool (see pooled_blist) returns
+    // the slabs in one call instead of freeing the nodes one by one, when
+    // they need no destructor.
+    ~blist() {
+        if constexpr ( _pooled ) {
+            if ( _alloc.sole_owner() ) {
+                _alloc.pool().release();
+                return;
+            }
+        }
+        _free_node( _root );
+    }
 
+    // Unless the allocator propagates, the elements of o are moved one by
+    // one if its allocator differs.
+    blist &operator=( blist &&o ) noexcept( alloc_traits::propagate_on_container_move_assignment::value
+                                            || alloc_traits::is_always_equal::value ) {
+        if constexpr ( !alloc_traits::propagate_on_container_move_assignment::value ) {
+            if ( _alloc != o._alloc )
+                return *this = blist( std::move( o ), _alloc );
+        } else
+            std::swap( _alloc, o._alloc );
+        std::swap( _root, o._root );
+        std::swap( _size, o._size );
+        std::swap( _first, o._first );
+        std::swap( _last, o._last );
+        std::swap( _min, o._min );
+        return *this;
+    }
 
-    bool empty() const;
-    size_t size() const;
+    blist &operator=( const blist &o ) {
+        if ( &o == this )
+            return *this;
+        if constexpr ( alloc_traits::propagate_on_container_copy_assignment::value )
+            *this = blist( o, o._alloc );
+        else
+            *this = blist( o, _alloc );
+        return *this;
+    }
+
+    allocator_type get_allocator() const noexcept { return _alloc; }
+
+    bool empty() const noexcept { return _size == 0; }
+    size_t size() const noexcept { return _size; }
 
     // Returns the number of nodes on the path from root to leaf (i.e.
     // if root is the only leaf then depth() == 1)
-    size_t depth() const;
+    size_t depth() const noexcept {
+        size_t d = 0;
+        for ( const node_base *n = _root; n; n = _first_child( n ) )
+            ++d;
+        return d;
+    }
 
-    iterator begin();
-    const_iterator begin() const;
-    const_iterator cbegin() const;
+    iterator begin() noexcept { return _begin( *this ); }
+    const_iterator begin() const noexcept { return _begin( *this ); }
+    const_iterator cbegin() const noexcept { return _begin( *this ); }
 
-    iterator end();
-    const_iterator end() const;
-    const_iterator cend() const;
+    iterator end() noexcept { return _end( *this ); }
+    const_iterator end() const noexcept { return _end( *this ); }
+    const_iterator cend() const noexcept { return _end( *this ); }
 
-    reverse_iterator rbegin();
-    const_reverse_iterator rbegin() const;
-    const_reverse_iterator crbegin() const;
+    reverse_iterator rbegin() noexcept { return reverse_iterator( end() ); }
+    const_reverse_iterator rbegin() const noexcept { return const_reverse_iterator( end() ); }
+    const_reverse_iterator crbegin() const noexcept { return const_reverse_iterator( end() ); }
 
-    reverse_iterator rend();
-    const_reverse_iterator rend() const;
-    const_reverse_iterator crend() const;
+    reverse_iterator rend() noexcept { return reverse_iterator( begin() ); }
+    const_reverse_iterator rend() const noexcept { return const_reverse_iterator( begin() ); }
+    const_reverse_iterator crend() const noexcept { return const_reverse_iterator( begin() ); }
 
-    reference front();
-    const_reference front() const;
+    reference front() { return *begin(); }
+    const_reference front() const { return *begin(); }
 
-    reference back();
-    const_reference back() const;
+    reference back() { return *std::prev( end() ); }
+    const_reference back() const { return *std::prev( end() ); }
 
+    // Both ends are reached through the cached edge leaves. Unless the edge
+    // leaf is full, the element is added to it and the count (and aggregate)
+    // of one child is updated per level on the way up, see _emplace_edge().
+    // Besides that O(1) per level, emplace_front shifts the first leaf, which
+    // a deque_blist leaf does not.
     template< typename... Args >
-    void emplace_back( Args &&...args );
+    void emplace_back( Args &&...args ) { _emplace_edge< false >( std::forward< Args >( args )... ); }
 
-    void push_back( const T &x );
-    void push_back( T &&x );
+    void push_back( const T &x ) { emplace_back( x ); }
+    void push_back( T &&x ) { emplace_back( std::move( x ) ); }
 
     template< typename... Args >
-    void emplace_front( Args &&...args );
+    void emplace_front( Args &&...args ) { _emplace_edge< true >( std::forward< Args >( args )... ); }
 
-    void push_front( const T &x );
-    void push_front( T &&x );
+    void push_front( const T &x ) { emplace_front( x ); }
+    void push_front( T &&x ) { emplace_front( std::move( x ) ); }
 
     // NOTE: signature changed compared to std, where the iterator would be const
     template< typename... Args >
-    iterator emplace( iterator pos, Args &&...args );
+    iterator emplace( iterator pos, Args &&...args ) {
+        if ( !_root ) {
+            auto *leaf = _new_leaf();
+            _root = _first = _last = leaf;
+            pos = iterator( leaf, 0 );
+        } else
+            pos = _unshare_path( pos );
+
+        leaf_node *leaf = pos._leaf;
+        size_t idx = pos._idx;
+        if ( leaf->data.full() ) {
+            leaf_node *right = _split_leaf( leaf );
+            if ( idx > min_leaf ) {
+                leaf = right;
+                idx -= min_leaf;
+            }
+        }
+        leaf->data.emplace( leaf->data.begin() + idx, std::forward< Args >( args )... );
+        _propagate( leaf, 1 );
+        ++_size;
+        return iterator( leaf, idx );
+    }
+
+    iterator insert( iterator pos, const T &value ) { return emplace( pos, value ); }
+    iterator insert( iterator pos, T &&value ) { return emplace( pos, std::move( value ) ); }
+
+    // Inserts [first, last) before pos. Unless the elements fit into the leaf
+    // of pos, they are bulk loaded into fresh leaves which are then spliced in
+    // using split and concat, i.e. in O(log n + k) time. If this throws, the
+    // list keeps its elements, with or without the new ones (see _rejoin()).
+    template< typename It, typename = typename std::iterator_traits< It >::value_type >
+    iterator insert( iterator pos, It first, It last ) {
+        using category = typename std::iterator_traits< It >::iterator_category;
+        if constexpr ( std::is_base_of_v< std::forward_iterator_tag, category > ) {
+            size_t cnt = std::distance( first, last );
+            if ( cnt == 0 )
+                return pos;
+            if ( pos._leaf && pos._leaf->data.size() + cnt <= leaf_size ) {
+                pos = _unshare_path( pos );
+                auto &data = pos._leaf->data;
+                data.insert( data.begin() + pos._idx, first, last );
+                _propagate( pos._leaf, cnt );
+                _size += cnt;
+                return pos;
+            }
+        }
+        blist mid( first, last, _alloc );
+        mid._min = _min;
+        if ( mid.empty() )
+            return pos;
+        size_t idx = _root ? _index_of( pos._leaf, pos._idx ) : 0;
+        auto tail = split( pos );
+        try {
+            concat( std::move( mid ) );
+        } catch ( ... ) {
+            _rejoin( std::move( tail ) );
+            throw;
+        }
+        _rejoin( std::move( tail ) );
+        return _iterator_at( idx );
+    }
+
+    iterator insert( iterator pos, std::initializer_list< T > ilist ) {
+        return insert( pos, ilist.begin(), ilist.end() );
+    }
+
+    iterator erase( iterator pos ) {
+        pos = _unshare_path( pos );
+        size_t idx = _index_of( pos._leaf, pos._idx );
+        leaf_node *leaf = pos._leaf;
+        leaf->data.erase( leaf->data.begin() + pos._idx );
+        _propagate( leaf, -1 );
+        if ( --_size == 0 ) {
+            _free_node( std::exchange( _root, nullptr ) );
+            _first = _last = nullptr;
+            return end();
+        }
+        _rebalance( leaf );
+        return _iterator_at( idx );
+    }
+
+    // Removes [first, last). Whole subtrees inside the range are dropped and
+    // only the nodes along the two boundary paths are fixed, which takes
+    // O(log n + k / LeafCapacity) node operations. If this throws, the list
+    // keeps its elements (see _rejoin()).
+    iterator erase( iterator first, iterator last ) {
+        if ( first == last )
+            return last;
+        size_t from = _index_of( first._leaf, first._idx );
+        size_t to = _index_of( last._leaf, last._idx );
+        auto tail = split( _iterator_at( to ) );
+        try {
+            split( _iterator_at( from ) );
+        } catch ( ... ) {
+            _rejoin( std::move( tail ) );
+            throw;
+        }
+        _rejoin( std::move( tail ) );
+        return _iterator_at( from );
+    }
+
+    // Applies all edits in a single pass over the tree. The edits are sorted
+    // by position (stably, inserts at the same position keep their order),
+    // every leaf they fall into is rewritten once and the internal nodes
+    // above them are rebuilt once on the way back to the root: underfull
+    // children are merged with or evened out with their neighbours and the
+    // children are regrouped, instead of splitting and rebalancing after
+    // every edit. Subtrees without edits are kept as they are. Every element
+    // can be erased at most once, positions of erases are less than size()
+    // and those of inserts at most size(). Each leaf with edits is copied
+    // out and back, so this beats single inserts and erases only when most
+    // of them share a leaf with others. If this throws, the list keeps the
+    // elements not erased, in order, with the edits applied to some of its
+    // leaves only (see _restore()).
+    void apply_batch( std::vector< edit > edits ) {
+        if ( edits.empty() )
+            return;
+        auto by_pos = []( const edit &a, const edit &b ) { return a.pos < b.pos; };
+        if ( !std::is_sorted( edits.begin(), edits.end(), by_pos ) )
+            std::stable_sort( edits.begin(), edits.end(), by_pos );
+        assert( edits.back().pos <= _size );
+        size_t size = _size;
+        for ( const auto &e : edits )
+            size = e.kind == edit::insert ? size + 1 : size - 1;
+
+        if ( !_root ) {
+            std::vector< T > values;
+            values.reserve( edits.size() );
+            for ( auto &e : edits ) {
+                assert( e.kind == edit::insert );
+                values.push_back( std::move( e.value ) );
+            }
+            _bulk_load( std::make_move_iterator( values.begin() ), std::make_move_iterator( values.end() ) );
+            return;
+        }
+
+        std::vector< subtree > level;
+        std::vector< T > buf;
+        try {
+            _apply_edits( _root, edits.data(), edits.data() + edits.size(), 0, level, buf );
+            _mend( level );
+            while ( level.size() > 1 )
+                level = _regroup( level, nullptr );
+        } catch ( ... ) {
+            // the root is still in place if copying it threw
+            node_ptr root = _own( std::exchange( _root, nullptr ) );
+            _restore( [ & ] {
+                std::vector< node_ptr > leaves;
+                _collect_leaves( std::move( root ), leaves );
+                for ( auto &s : level )
+                    _collect_leaves( std::move( s.node ), leaves );
+                return leaves;
+            } );
+            throw;
+        }
+        _size = size;
+        if ( level.empty() ) {
+            _first = _last = nullptr;
+            return;
+        }
+        _root = level.front().node.release();
+        _root->parent = nullptr;
+        // the levels below a lone child can have shrunk to a single node
+        while ( !_root->leaf && _as_internal( _root )->children.size() == 1 ) {
+            auto *root = _as_internal( _root );
+            _root = root->children.front();
+            _root->parent = nullptr;
+            root->children.clear();
+            _free_node( root );
+        }
+        _reset_edges();
+    }
+
+    // Moves all elements of o to the end of this blist. Only the nodes along
+    // the seam between the two trees are touched, which takes O(log n). The
+    // result keeps the lower of the two minimum fills. If this throws, both
+    // lists keep their elements.
+    void concat( blist &&o ) {
+        assert( &o != this );
+        assert( _alloc == o._alloc );
+        _absorb( o );
+        bool link = _root && o._root;
+        if ( link )
+            _link_leaves( _last, o._first );
+        size_t h = depth();
+        try {
+            _join( std::move( o ), h, o.depth() );
+        } catch ( ... ) {
+            if ( link ) {
+                _last->next = nullptr;
+                o._first->prev = nullptr;
+            }
+            throw;
+        }
+        _reset_edges();
+        o._first = o._last = nullptr;
+    }
+
+    friend blist join( blist &&l, blist &&r ) {
+        l.concat( std::move( r ) );
+        return std::move( l );
+    }
+
+    // Moves elements [pos, end()) to a new blist which is returned. The trees
+    // are cut along the path from the root to pos and the resulting subtrees
+    // are joined again, which takes O(log n). The nodes the cuts need are
+    // allocated first, so only the joins can throw. If one does, the pieces
+    // are put together again (see _restore()), the list keeps its elements.
+    blist split( iterator pos ) {
+        if ( pos == end() ) {
+            blist right( _alloc );
+            right._min = _min;
+            return right;
+        }
+        pos = _unshare_path( pos );
+
+        std::vector< std::pair< internal_node *, size_t > > path;
+        for ( node_base *n = pos._leaf; n->parent; n = n->parent )
+            path.emplace_back( n->parent, _child_index( n->parent, n ) );
+
+        // lefts[ 0 ] and rights[ 0 ] are the two halves of the leaf of pos,
+        // lefts[ k ] and rights[ k ] the siblings of the k-th node of the
+        // path, each with the depth of its tree
+        std::vector< std::pair< blist, size_t > > lefts, rights;
+        lefts.reserve( path.size() + 1 );
+        rights.reserve( path.size() + 1 );
+        auto piece = [&]( auto &pieces ) -> blist & {
+            auto &res = pieces.emplace_back( std::piecewise_construct, std::tuple( _alloc ), std::tuple( 0 ) );
+            res.first._min = _min;
+            return res.first;
+        };
+        node_ptr rleaf = _own( _new_leaf() );
+        std::vector< node_ptr > roots( 2 * path.size() );
+        for ( size_t k = 0; k < path.size(); ++k ) {
+            auto [ p, i ] = path[ k ];
+            if ( i > 1 )
+                roots[ 2 * k ] = _own( _new_internal() );
+            if ( p->children.size() - i > 2 )
+                roots[ 2 * k + 1 ] = _own( _new_internal() );
+        }
+
+        leaf_node *leaf = pos._leaf;
+        auto &data = leaf->data;
+        leaf->parent = nullptr;
+        _root = nullptr;
+        _size = 0;
+
+        auto &left = piece( lefts );
+        if ( pos._idx > 0 ) {
+            left._root = leaf;
+            left._size = pos._idx;
+            lefts.back().second = 1;
+        }
+
+        auto &rdata = _as_leaf( rleaf.get() )->data;
+        rdata.splice( rdata.end(), data, data.begin() + pos._idx, data.end() );
+        _link_leaves( _as_leaf( rleaf.get() ), leaf->next );
+        if ( left._root )
+            leaf->next = nullptr;
+        else {
+            _link_leaves( leaf->prev, nullptr );
+            _free_node( leaf );
+        }
+        auto &right = piece( rights );
+        right._size = rdata.size();
+        right._root = rleaf.release();
+        rights.back().second = 1;
+
+        size_t h = 1;
+        for ( size_t k = 0; k < path.size(); ++k, ++h ) {
+            auto [ p, i ] = path[ k ];
+            lefts.push_back( _cut( p, 0, i, h, roots[ 2 * k ] ) );
+            rights.push_back( _cut( p, i + 1, p->children.size(), h, roots[ 2 * k + 1 ] ) );
+            p->children.clear();
+            _free_node( p );
+        }
+
+        // the left pieces are joined from the bottom, each to the end of the
+        // next one, the right ones to the end of the first
+        try {
+            for ( size_t k = 1; k < lefts.size(); ++k ) {
+                auto &[ l, lh ] = lefts[ k ];
+                lh = l._join( std::move( lefts[ k - 1 ].first ), lh, lefts[ k - 1 ].second );
+            }
+            for ( size_t k = 1; k < rights.size(); ++k )
+                rights[ 0 ].second = right._join( std::move( rights[ k ].first ), rights[ 0 ].second,
+                                                  rights[ k ].second );
+        } catch ( ... ) {
+            _restore( [&] {
+                std::vector< node_ptr > leaves;
+                auto take = [&]( blist &l ) {
+                    l._size = 0;
+                    _collect_leaves( _own( std::exchange( l._root, nullptr ) ), leaves );
+                };
+                for ( size_t k = lefts.size(); k-- > 0; )
+                    take( lefts[ k ].first );
+                for ( auto &[ r, rh ] : rights )
+                    take( r );
+                return leaves;
+            } );
+            throw;
+        }
+
+        *this = std::move( lefts.back().first );
+        _reset_edges();
+        right._reset_edges();
+        return std::move( right );
+    }
+
+    reference operator[]( size_t idx ) { return *_iterator_at( idx ); }
+    const T &operator[]( size_t idx ) const { return *_const_iterator_at( idx ); }
+
+    // Calls f( x ) with a mutable reference to the element at pos, which is
+    // the way to change elements of an augmented blist.
+    template< typename F >
+    void modify( iterator pos, F f ) {
+        pos = _unshare_path( pos );
+        f( pos._leaf->data[ pos._idx ] );
+        if constexpr ( augmented )
+            _propagate( pos._leaf, 0 );
+    }
+
+    // Combines the elements [from, to) by the monoid, from <= to <= size().
+    // Subtrees inside the range contribute their stored aggregates, so only
+    // the two boundary paths are visited.
+    template< typename M = Monoid >
+    typename M::value_type range_query( size_t from, size_t to ) const {
+        assert( from <= to && to <= _size );
+        if ( from == to )
+            return Monoid::identity();
+        return _query( _root, from, to );
+    }
+
+    // Ordered lists (see ordered_blist), the elements have to be sorted by
+    // key_compare. The descent picks the first child whose maximum key is
+    // not less than key (greater than key for upper_bound) by a binary
+    // search over the aggregates and then searches the leaf the same way,
+    // which takes O(log n). The rank of the result is `it - begin()`.
+    template< typename K, typename M = Monoid >
+    iterator lower_bound( const K &key ) { return _bound< typename M::key_compare, false >( *this, key ); }
+    template< typename K, typename M = Monoid >
+    const_iterator lower_bound( const K &key ) const {
+        return _bound< typename M::key_compare, false >( *this, key );
+    }
+
+    template< typename K, typename M = Monoid >
+    iterator upper_bound( const K &key ) { return _bound< typename M::key_compare, true >( *this, key ); }
+    template< typename K, typename M = Monoid >
+    const_iterator upper_bound( const K &key ) const {
+        return _bound< typename M::key_compare, true >( *this, key );
+    }
+
+    template< typename K, typename M = Monoid >
+    std::pair< iterator, iterator > equal_range( const K &key ) {
+        return { lower_bound( key ), upper_bound( key ) };
+    }
+    template< typename K, typename M = Monoid >
+    std::pair< const_iterator, const_iterator > equal_range( const K &key ) const {
+        return { lower_bound( key ), upper_bound( key ) };
+    }
+
+    // Inserts value into an ordered list after the elements equivalent to
+    // it, as std::multiset::insert does. Takes O(log n).
+    template< typename M = Monoid >
+    iterator insert_sorted( const typename M::value_type &value ) {
+        return emplace( upper_bound( value ), value );
+    }
+    template< typename M = Monoid >
+    iterator insert_sorted( typename M::value_type &&value ) {
+        auto pos = upper_bound( value );
+        return emplace( pos, std::move( value ) );
+    }
+
+    // Erases the elements of an ordered list equivalent to key, returns their
+    // number. Takes O(log n + k / LeafCapacity) node operations, see erase.
+    template< typename K, typename M = Monoid >
+    size_t erase_value( const K &key ) {
+        auto [ first, last ] = equal_range( key );
+        size_t cnt = last - first;
+        if ( cnt != 0 )
+            erase( first, last );
+        return cnt;
+    }
+
+    // Cursor at pos for localized edits, see list_cursor.
+    cursor cursor_at( iterator pos ) noexcept { return cursor( this, pos ); }
+
+    // Takes a snapshot of the current contents in O(1), persistent lists only.
+    template< bool P = persistent, typename = std::enable_if_t< P > >
+    snapshot_type snapshot() const { return snapshot_view( _root, _size, _alloc ); }
+
+    // Segmented access: the elements of each leaf are stored contiguously,
+    // loops over the segments are simple pointer loops the compiler can
+    // vectorize.
+    segment_range segments() noexcept { return { _segments_begin( *this ) }; }
+    const_segment_range segments() const noexcept { return { _segments_begin( *this ) }; }
+
+    // Calls f( first, last ) with pointers delimiting the elements of every leaf.
+    // The aggregates of an augmented blist are recomputed afterwards.
+    template< typename F >
+    void for_each_segment( F &&f ) {
+        _unshare_all( _root );
+        _for_each_segment( begin(), end(), f );
+        _refresh( begin(), end() );
+    }
+
+    template< typename F >
+    void for_each_segment( F &&f ) const { _for_each_segment( begin(), end(), f ); }
+
+    // Overloads of the standard algorithms which work leaf by leaf, they are
+    // found by argument-dependent lookup for blist iterators (e.g. after
+    // `using std::fill;`) and are preferred over the generic versions.
+    template< typename N, typename OutIt >
+    friend OutIt copy( base_iterator< N > first, base_iterator< N > last, OutIt out ) {
+        _for_each_segment( first, last, [&]( auto *b, auto *e ) { out = std::copy( b, e, out ); } );
+        return out;
+    }
+
+    friend void fill( iterator first, iterator last, const T &value ) {
+        static_assert( !persistent, "fill cannot copy the nodes shared with snapshots" );
+        _for_each_segment( first, last, [&]( T *b, T *e ) { std::fill( b, e, value ); } );
+        _refresh( first, last );
+    }
+
+    template< typename N, typename Init, typename Op = std::plus<> >
+    friend Init accumulate( base_iterator< N > first, base_iterator< N > last, Init init, Op op = {} ) {
+        _for_each_segment( first, last, [&]( auto *b, auto *e ) {
+                init = std::accumulate( b, e, std::move( init ), op );
+            } );
+        return init;
+    }
 
-    iterator insert( iterator pos, const T &value );
-    iterator insert( iterator pos, T &&value );
+    template< typename N, typename Val >
+    friend base_iterator< N > find( base_iterator< N > first, base_iterator< N > last, const Val &value ) {
+        return _find( first, last, value );
+    }
 
-    iterator erase( iterator pos );
+    // Parallel algorithms. The tree is cut into tasks along child boundaries:
+    // subtrees bigger than the grain size are split further and runs of
+    // smaller neighbouring subtrees are grouped, so that every task covers
+    // between one and two grains of elements. The tasks run in a
+    // work-stealing pool, the calling thread helps until all of them finish.
+
+    // calls f( x ) for every element, in no particular order
+    template< typename F >
+    void parallel_for_each( F f, thread_pool &pool = thread_pool::global() ) {
+        _unshare_all( _root );
+        _parallel( *this, pool, [&]( size_t, leaf_node *first, leaf_node *last ) {
+                for ( ; first != last; first = first->next )
+                    std::for_each( first->data.begin(), first->data.end(), f );
+            } );
+        _refresh( begin(), end() );
+    }
+
+    template< typename F >
+    void parallel_for_each( F f, thread_pool &pool = thread_pool::global() ) const {
+        _parallel( *this, pool, [&]( size_t, const leaf_node *first, const leaf_node *last ) {
+                for ( ; first != last; first = first->next )
+                    std::for_each( first->data.begin(), first->data.end(), f );
+            } );
+    }
+
+    // replaces every element x by f( x )
+    template< typename F >
+    void parallel_transform( F f, thread_pool &pool = thread_pool::global() ) {
+        _unshare_all( _root );
+        _parallel( *this, pool, [&]( size_t, leaf_node *first, leaf_node *last ) {
+                for ( ; first != last; first = first->next )
+                    std::transform( first->data.begin(), first->data.end(), first->data.begin(), f );
+            } );
+        _refresh( begin(), end() );
+    }
+
+    // Generalized sum of init and all elements as in std::reduce: op has to be
+    // associative and commutative and accept any combination of U and T.
+    template< typename U, typename Op = std::plus<> >
+    U parallel_reduce( U init, Op op = {}, thread_pool &pool = thread_pool::global() ) const {
+        std::vector< std::optional< U > > partial;
+        _parallel( *this, pool, [&]( size_t i, const leaf_node *first, const leaf_node *last ) {
+                U acc( first->data.front() );
+                acc = std::accumulate( first->data.begin() + 1, first->data.end(), std::move( acc ), op );
+                while ( ( first = first->next ) != last )
+                    acc = std::accumulate( first->data.begin(), first->data.end(), std::move( acc ), op );
+                partial[ i ].emplace( std::move( acc ) );
+            }, [&]( size_t chunks ) { partial.resize( chunks ); } );
+        for ( auto &p : partial )
+            init = op( std::move( init ), std::move( *p ) );
+        return init;
+    }
+
+    // Sorts the elements by cmp, stably. The leaves are cut into runs as for
+    // the parallel algorithms and the runs are sorted in the pool, a run of
+    // a single leaf in place, a longer one through a buffer the size of the
+    // run. A multi-way merge of the runs (a tournament tree, log2 of their
+    // number comparisons per element) then moves the elements into new
+    // leaves filled as by bulk loading, every old leaf is freed as soon as
+    // the merge consumes it. Takes O(n log n) and invalidates all iterators.
+    // If cmp throws, the list is left valid with its size, in unspecified
+    // order. The run std::stable_sort was sorting when cmp threw may hold
+    // moved-from elements in place of some of its own, all the others keep
+    // their elements.
+    template< typename Compare = std::less<> >
+    void sort( Compare cmp = {}, thread_pool &pool = thread_pool::global() ) {
+        if ( !_root )
+            return;
+        _unshare_all( _root );
+        std::vector< leaf_node * > firsts;
+        _parallel( *this, pool, [&]( size_t i, leaf_node *first, leaf_node *last ) {
+                firsts[ i ] = first;
+                if ( first->next == last ) {
+                    std::stable_sort( first->data.begin(), first->data.end(), cmp );
+                    return;
+                }
+                size_t cnt = 0;
+                for ( leaf_node *l = first; l != last; l = l->next )
+                    cnt += l->data.size();
+                std::vector< T > buf;
+                buf.reserve( cnt );
+                for ( leaf_node *l = first; l != last; l = l->next )
+                    buf.insert( buf.end(), std::make_move_iterator( l->data.begin() ),
+                                           std::make_move_iterator( l->data.end() ) );
+                // the elements go back to the leaves even if cmp throws
+                auto put_back = [&] {
+                    auto src = buf.begin();
+                    for ( leaf_node *l = first; l != last; l = l->next )
+                        for ( auto &x : l->data )
+                            x = std::move( *src++ );
+                };
+                try {
+                    std::stable_sort( buf.begin(), buf.end(), cmp );
+                } catch ( ... ) {
+                    put_back();
+                    throw;
+                }
+                put_back();
+            }, [&]( size_t chunks ) { firsts.resize( chunks ); } );
+
+        // run r covers the leaves [ leaf, end ), pos and left describe the
+        // rest of the current one
+        struct run_head {
+            size_t leaf, end;
+            typename leaf_storage::iterator pos;
+            size_t left;
+        };
+        size_t k = firsts.size();
+        std::vector< run_head > heads( k );
+        leaf_sink out( *this, _size, leaf_fill );
+        auto leaves = _take_leaves();
+        for ( size_t r = 0, l = 0; r < k; ++r ) {
+            while ( leaves[ l ].get() != firsts[ r ] )
+                ++l;
+            auto &data = _as_leaf( leaves[ l ].get() )->data;
+            heads[ r ] = { l, 0, data.begin(), data.size() };
+            if ( r > 0 )
+                heads[ r - 1 ].end = l;
+        }
+        heads.back().end = leaves.size();
+
+        try {
+            // run a goes before run b: exhausted runs (and the padding up to a
+            // power of two) go last, equivalent elements in the order of runs
+            auto before = [&]( size_t a, size_t b ) {
+                if ( a >= k || heads[ a ].leaf == heads[ a ].end )
+                    return false;
+                if ( b >= k || heads[ b ].leaf == heads[ b ].end )
+                    return true;
+                return a < b ? !cmp( *heads[ b ].pos, *heads[ a ].pos )
+                             : bool( cmp( *heads[ a ].pos, *heads[ b ].pos ) );
+            };
+
+            // losers[ i ] is the run that lost the match in node i of the tree,
+            // the leaves of the tree are the nodes width + r
+            size_t width = 1;
+            while ( width < k )
+                width *= 2;
+            std::vector< size_t > losers( width ), winners( 2 * width );
+            for ( size_t r = 0; r < width; ++r )
+                winners[ width + r ] = r;
+            for ( size_t i = width - 1; i > 0; --i ) {
+                size_t a = winners[ 2 * i ], b = winners[ 2 * i + 1 ];
+                bool a_wins = before( a, b );
+                winners[ i ] = a_wins ? a : b;
+                losers[ i ] = a_wins ? b : a;
+            }
+
+            size_t win = winners[ 1 ];
+            for ( size_t i = 0; i < _size; ++i ) {
+                auto &h = heads[ win ];
+                out.push( std::move( *h.pos ) );
+                ++h.pos;
+                if ( --h.left == 0 ) {
+                    leaves[ h.leaf++ ].reset();
+                    if ( h.leaf != h.end ) {
+                        auto &data = _as_leaf( leaves[ h.leaf ].get() )->data;
+                        h.pos = data.begin();
+                        h.left = data.size();
+                    }
+                }
+                for ( size_t node = ( width + win ) / 2; node > 0; node /= 2 )
+                    if ( before( losers[ node ], win ) )
+                        std::swap( losers[ node ], win );
+            }
+            out.finish( fanout_fill );
+        } catch ( ... ) {
+            // the sorted output, then the rest of the runs without the
+            // elements moved out of them
+            _restore( [&] {
+                for ( auto &h : heads ) {
+                    if ( h.leaf != h.end ) {
+                        auto &data = _as_leaf( leaves[ h.leaf ].get() )->data;
+                        data.erase( data.begin(), h.pos );
+                    }
+                }
+                auto &res = out.leaves();
+                res.insert( res.end(), std::make_move_iterator( leaves.begin() ),
+                                       std::make_move_iterator( leaves.end() ) );
+                return std::move( res );
+            } );
+            throw;
+        }
+    }
+
+    // Merges o into this list, both sorted by cmp, as std::list::merge does:
+    // of equivalent elements, those of this list come first and o is left
+    // empty. The elements are moved into new leaves packed full in a single
+    // pass over both leaf lists, which takes O(n + m), the old leaves are
+    // freed as the merge consumes them. As with concat, the result keeps the
+    // lower of the two minimum fills, unlike concat o may use an unequal
+    // allocator. If cmp throws, this list is left with the elements of both,
+    // in unspecified order (see _restore()).
+    template< typename Compare = std::less<> >
+    void merge( blist &&o, Compare cmp = {} ) {
+        assert( &o != this );
+        _absorb( o );
+        size_t n = _size + o._size;
+        if ( n == 0 )
+            return;
+        leaf_sink out( *this, n, leaf_size );
+        auto left = _take_leaves();
+        std::vector< node_ptr > right;
+        size_t l = 0, r = 0, li = 0, ri = 0;
+        try {
+            right = o._take_leaves();
+            o._size = 0;
+            o._reset_edges();
+
+            auto data = []( std::vector< node_ptr > &leaves, size_t i ) -> auto & {
+                return _as_leaf( leaves[ i ].get() )->data;
+            };
+            // moves the element at ( i, pos ) of leaves to the output
+            auto take = [&]( std::vector< node_ptr > &leaves, size_t &i, size_t &pos ) {
+                out.push( std::move( data( leaves, i )[ pos ] ) );
+                if ( ++pos == data( leaves, i ).size() ) {
+                    leaves[ i++ ].reset();
+                    pos = 0;
+                }
+            };
+            while ( l < left.size() && r < right.size() ) {
+                if ( cmp( data( right, r )[ ri ], data( left, l )[ li ] ) )
+                    take( right, r, ri );
+                else
+                    take( left, l, li );
+            }
+            while ( l < left.size() )
+                take( left, l, li );
+            while ( r < right.size() )
+                take( right, r, ri );
+            _size = n;
+            out.finish( fanout );
+        } catch ( ... ) {
+            // the merged output, then the rest of this list and of o without
+            // the elements moved out of them. The leaves of o move into new
+            // ones if the allocators differ, the old ones are freed by o's.
+            _restore( [&] {
+                auto &res = out.leaves();
+                auto append = [&]( std::vector< node_ptr > &leaves, size_t i, size_t pos, bool own ) {
+                    if ( i < leaves.size() ) {
+                        auto &data = _as_leaf( leaves[ i ].get() )->data;
+                        data.erase( data.begin(), data.begin() + pos );
+                    }
+                    for ( ; !own && i < leaves.size(); ++i ) {
+                        node_ptr leaf = _own( _new_leaf() );
+                        _as_leaf( leaf.get() )->data = std::move( _as_leaf( leaves[ i ].get() )->data );
+                        leaves[ i ] = std::move( leaf );
+                    }
+                    res.insert( res.end(), std::make_move_iterator( leaves.begin() ),
+                                           std::make_move_iterator( leaves.end() ) );
+                };
+                append( left, l, li, true );
+                append( right, r, ri, _alloc == o._alloc );
+                return std::move( res );
+            } );
+            throw;
+        }
+    }
+
+    // Walks the whole tree, i.e. takes O(n / LeafCapacity). Nodes shared with
+    // snapshots are reported as well.
+    blist_stats stats() const {
+        blist_stats s;
+        s.depth = depth();
+        if ( _root )
+            _stats( _root, s );
+        s.bytes_used = s.leaves * sizeof( leaf_node ) + s.internal_nodes * sizeof( internal_node );
+        s.bytes_live = _size * sizeof( T );
+        return s;
+    }
+
+    // Sets the minimum fill of the nodes other than the root to the fraction
+    // fill of their capacity, at most one half, which is the default. Erases
+    // merge or borrow entries only when a node drops below the minimum, so a
+    // lower one saves that work in erase-heavy phases, at the price of
+    // sparser nodes (see compact()). Raising the minimum compacts the list,
+    // so that all nodes meet it.
+    void set_min_fill( double fill ) {
+        fill = std::clamp( fill, 0.0, 0.5 );
+        fill_bounds min{ std::clamp< size_t >( size_t( fill * leaf_size ), 1, min_leaf ),
+                         std::clamp< size_t >( size_t( fill * fanout ), 2, min_fanout ) };
+        bool raised = min.leaf > _min.leaf || min.internal > _min.internal;
+        _min = min;
+        if ( raised )
+            compact();
+    }
+
+    double min_fill() const noexcept { return double( _min.leaf ) / leaf_size; }
+
+    // Repacks the elements into leaves filled to fill_factor of their
+    // capacity (but at least to the minimum fill) in one pass over the leaf
+    // list and builds the internal levels on top of them anew, filled the
+    // same way. Erases leave the nodes anywhere down to the minimum fill,
+    // which costs memory and depth in the read-mostly phases that often
+    // follow. The leaves are reused, those left over are freed. Takes O(n)
+    // and invalidates all iterators.
+    void compact( double fill_factor = 1.0 ) {
+        if ( !_root )
+            return;
+        fill_factor = std::clamp( fill_factor, 0.0, 1.0 );
+        size_t leaf_target = std::clamp( size_t( fill_factor * leaf_size ), _min.leaf, leaf_size );
+        size_t fanout_target = std::clamp( size_t( fill_factor * fanout ), _min.internal, fanout );
+        size_t k = _chunks( _size, leaf_target, _min.leaf );
+        std::vector< node_ptr > level;
+        std::vector< node_ptr > spare;
+        level.reserve( k );
+        auto leaves = _take_leaves();
+
+        // The leaf holding the next elements becomes the next packed leaf and
+        // takes the following elements from the leaves after it. If it holds
+        // too many, the rest goes to a leaf emptied before, which takes its
+        // place in the queue. Every leaf stays in level or leaves, from which
+        // _restore() rebuilds the tree if a splice or allocation throws.
+        try {
+            for ( size_t i = 0, src = 0; i < k; ++i ) {
+                size_t cnt = _chunk_size( _size, k, i );
+                auto &data = _as_leaf( leaves[ src ].get() )->data;
+                if ( data.size() > cnt ) {
+                    if ( spare.empty() )
+                        spare.push_back( _own( _new_leaf() ) );
+                    auto &r = _as_leaf( spare.back().get() )->data;
+                    r.splice( r.end(), data, data.begin() + cnt, data.end() );
+                    level.push_back( std::move( leaves[ src ] ) );
+                    leaves[ src ] = std::move( spare.back() );
+                    spare.pop_back();
+                    continue;
+                }
+                size_t next = src + 1;
+                while ( data.size() < cnt ) {
+                    auto &d = _as_leaf( leaves[ next ].get() )->data;
+                    size_t take = std::min( cnt - data.size(), d.size() );
+                    data.splice( data.end(), d, d.begin(), d.begin() + take );
+                    if ( d.empty() )
+                        spare.push_back( std::move( leaves[ next++ ] ) );
+                }
+                level.push_back( std::move( leaves[ src ] ) );
+                src = next;
+            }
+            _build_tree( level, fanout_target );
+        } catch ( ... ) {
+            _restore( [&] {
+                level.insert( level.end(), std::make_move_iterator( leaves.begin() ),
+                                           std::make_move_iterator( leaves.end() ) );
+                return std::move( level );
+            } );
+            throw;
+        }
+    }
+
+    // Packs the nodes full, see compact(). The nodes freed by that go back to
+    // the allocator, a node_pool then returns the slabs left without nodes
+    // to its upstream resource (see node_pool::trim()).
+    void shrink_to_fit() {
+        compact();
+        if constexpr ( std::is_same_v< Allocator, std::pmr::polymorphic_allocator< T > > ) {
+            if ( auto *pool = dynamic_cast< node_pool * >( _alloc.resource() ) )
+                pool->trim();
+        } else if constexpr ( std::is_same_v< Allocator, pool_allocator< T > > )
+            _alloc.pool().trim();
+    }
+
+    // The operations done through this object since it was constructed or
+    // since reset_counters(). Counters are not transferred by moves, concat
+    // adds those of the appended list (including the temporary lists used by
+    // split and the range insert and erase).
+    template< bool C = Counters, typename = std::enable_if_t< C > >
+    const blist_counters &counters() const noexcept { return _counters; }
+
+    template< bool C = Counters, typename = std::enable_if_t< C > >
+    void reset_counters() noexcept { _counters = {}; }
+
+    // Checks the tree invariants and consistency of parent pointers and
+    // element counts stored in the internal nodes.
+    void validate() const {
+        assert( ( _root == nullptr ) == ( _size == 0 ) );
+        if ( !_root )
+            return;
+        assert( _root->parent == nullptr );
+        const leaf_node *last = nullptr;
+        assert( _validate( _root, depth(), last ) == _size );
+        assert( last->next == nullptr );
+        assert( _first == _leftmost_leaf( _root ) );
+        assert( _last == last );
+    }
+
+  private:
+    using alloc_traits = std::allocator_traits< Allocator >;
+
+    // the nodes can be dropped together with the slabs of the pool
+    static constexpr bool _pooled = std::is_same_v< Allocator, pool_allocator< T > >
+                                    && std::is_trivially_destructible_v< leaf_node >
+                                    && std::is_trivially_destructible_v< internal_node >;
+
+    node_base *_root = nullptr;
+    size_t _size = 0;
+    Allocator _alloc;
+    // the leftmost and rightmost leaf, so that the ends are reached without
+    // a descent
+    leaf_node *_first = nullptr;
+    leaf_node *_last = nullptr;
+    std::conditional_t< counted, blist_counters, std::tuple<> > _counters;
+    fill_bounds _min;
+
+    // Increments the counter selected by member, does nothing without Counters.
+    void _count_op( [[maybe_unused]] size_t blist_counters::*member ) noexcept {
+        if constexpr ( counted )
+            ++( _counters.*member );
+    }
+
+    template< typename Node >
+    using node_alloc = typename alloc_traits::template rebind_alloc< Node >;
+
+    template< typename Node >
+    Node *_new_node() {
+        node_alloc< Node > alloc( _alloc );
+        using traits = std::allocator_traits< node_alloc< Node > >;
+        static_assert( std::is_same_v< typename traits::pointer, Node * >,
+                       "allocators with fancy pointers are not supported" );
+        Node *n = traits::allocate( alloc, 1 );
+        traits::construct( alloc, n );
+        _count_op( &blist_counters::allocations );
+        return n;
+    }
+
+    template< typename Node >
+    static void _delete_node( Node *n, const Allocator &a ) noexcept {
+        node_alloc< Node > alloc( a );
+        using traits = std::allocator_traits< node_alloc< Node > >;
+        traits::destroy( alloc, n );
+        traits::deallocate( alloc, n, 1 );
+    }
+
+    leaf_node *_new_leaf() { return _new_node< leaf_node >(); }
+    internal_node *_new_internal() { return _new_node< internal_node >(); }
+
+    node_ptr _own( node_base *n ) noexcept { return node_ptr( n, node_deleter{ &_alloc } ); }
+
+    void _free_node( node_base *n ) noexcept { _free_node( n, _alloc ); }
+
+    // Frees the subtree of n, a shared node only loses one owner.
+    static void _free_node( node_base *n, const Allocator &alloc ) noexcept {
+        if ( !n )
+            return;
+        if constexpr ( persistent ) {
+            if ( n->refs.fetch_sub( 1, std::memory_order_acq_rel ) != 1 )
+                return;
+        }
+        if ( n->leaf ) {
+            _delete_node( _as_leaf( n ), alloc );
+            return;
+        }
+        auto *in = _as_internal( n );
+        for ( auto *c : in->children )
+            _free_node( c, alloc );
+        _delete_node( in, alloc );
+    }
+
+    // Takes over the leaves, in order, and frees the internal nodes. The list
+    // is left without a tree, but keeps its size. If this throws, the tree
+    // is left as it was.
+    std::vector< node_ptr > _take_leaves() {
+        std::vector< node_ptr > leaves;
+        if ( !_root )
+            return leaves;
+        _unshare_all( _root );
+        size_t cnt = 0;
+        for ( leaf_node *leaf = _first; leaf; leaf = leaf->next )
+            ++cnt;
+        leaves.reserve( cnt );
+        for ( leaf_node *leaf = _first; leaf; leaf = leaf->next )
+            leaves.push_back( _own( leaf ) );
+        _free_internal( std::exchange( _root, nullptr ) );
+        return leaves;
+    }
+
+    // Appends tail, split off this list by an operation which puts it back
+    // whether it succeeds or not. If the concat throws, both lists are
+    // rebuilt into this one (see _restore()) and the exception is rethrown.
+    void _rejoin( blist &&tail ) {
+        try {
+            concat( std::move( tail ) );
+        } catch ( ... ) {
+            node_ptr head = _own( std::exchange( _root, nullptr ) );
+            node_ptr rest = _own( std::exchange( tail._root, nullptr ) );
+            tail._size = 0;
+            _restore( [&] {
+                std::vector< node_ptr > leaves;
+                _collect_leaves( std::move( head ), leaves );
+                _collect_leaves( std::move( rest ), leaves );
+                return leaves;
+            } );
+            throw;
+        }
+    }
+
+    // Rebuilds the tree after an operation that took it apart threw, which
+    // gives that operation the basic guarantee. gather() returns the leaves
+    // left, in order, null and partly empty ones included. Their elements are
+    // packed into full leaves, so the list keeps all elements that were not
+    // lost. If that throws as well, the list is left empty, the leaves are
+    // then freed by their owners.
+    template< typename Gather >
+    void _restore( Gather gather ) noexcept {
+        _root = nullptr;
+        _size = 0;
+        try {
+            std::vector< node_ptr > leaves = gather();
+            std::vector< node_ptr > level;
+            level.reserve( leaves.size() );
+            size_t size = 0;
+            for ( auto &l : leaves ) {
+                if ( !l )
+                    continue;
+                auto &data = _as_leaf( l.get() )->data;
+                size += data.size();
+                if ( !level.empty() ) {
+                    auto &last = _as_leaf( level.back().get() )->data;
+                    size_t take = std::min( leaf_size - last.size(), data.size() );
+                    last.splice( last.end(), data, data.begin(), data.begin() + take );
+                }
+                if ( !data.empty() )
+                    level.push_back( std::move( l ) );
+            }
+            if ( level.empty() ) {
+                _reset_edges();
+                return;
+            }
+            // all leaves but the last one are full, it borrows up to the minimum
+            if ( level.size() > 1 ) {
+                auto &prev = _as_leaf( level[ level.size() - 2 ].get() )->data;
+                auto &last = _as_leaf( level.back().get() )->data;
+                if ( last.size() < _min.leaf )
+                    last.splice( last.begin(), prev, prev.end() - ( _min.leaf - last.size() ), prev.end() );
+            }
+            _build_tree( level );
+            _size = size;
+        } catch ( ... ) {
+            _root = nullptr;
+            _reset_edges();
+        }
+    }
+
+    // Links the leaves of level and stacks internal levels filled to about
+    // fill children on top of them. The top becomes the root of the list,
+    // which must not have a tree. If this throws, level keeps the leaves.
+    void _build_tree( std::vector< node_ptr > &level, size_t fill = fanout_fill ) {
+        auto *first = _as_leaf( level.front().get() );
+        first->prev = nullptr;
+        _as_leaf( level.back().get() )->next = nullptr;
+        for ( size_t i = 1; i < level.size(); ++i )
+            _link_leaves( _as_leaf( level[ i - 1 ].get() ), _as_leaf( level[ i ].get() ) );
+        if ( level.size() > 1 ) {
+            auto upper = _build_level( level, fill, _min.internal );
+            try {
+                while ( upper.size() > 1 )
+                    upper = _build_level( upper, fill, _min.internal );
+            } catch ( ... ) {
+                // the leaves go back to level, the internal nodes are freed
+                for ( auto &n : upper )
+                    _free_internal( n.release() );
+                size_t i = 0;
+                for ( auto *leaf = first; leaf; leaf = leaf->next )
+                    level[ i++ ] = _own( leaf );
+                throw;
+            }
+            level = std::move( upper );
+        }
+        _root = level.front().release();
+        _root->parent = nullptr;
+        _reset_edges();
+    }
+
+    // Takes the lower of the minimum fills and the counters of a list whose
+    // elements are moved into this one (concat, merge).
+    void _absorb( blist &o ) noexcept {
+        _min.leaf = std::min( _min.leaf, o._min.leaf );
+        _min.internal = std::min( _min.internal, o._min.internal );
+        if constexpr ( counted ) {
+            _counters.splits += o._counters.splits;
+            _counters.merges += o._counters.merges;
+            _counters.borrows += o._counters.borrows;
+            _counters.allocations += o._counters.allocations;
+            o._counters = {};
+        }
+    }
+
+    // Frees the internal nodes of the subtree of n, which must not be shared,
+    // but none of its leaves.
+    void _free_internal( node_base *n ) noexcept {
+        if ( n->leaf )
+            return;
+        auto *in = _as_internal( n );
+        for ( auto *c : in->children )
+            _free_internal( c );
+        in->children.clear();
+        _free_node( in );
+    }
+
+    template< typename Node >
+    static Node *_acquire( Node *n ) noexcept {
+        if constexpr ( persistent ) {
+            if ( n )
+                n->refs.fetch_add( 1, std::memory_order_relaxed );
+        }
+        return n;
+    }
 
-    T &operator[]( size_t idx );
-    const T &operator[]( size_t idx ) const;
+    static bool _shared( [[maybe_unused]] const node_base *n ) noexcept {
+        if constexpr ( persistent )
+            return n->refs.load( std::memory_order_acquire ) != 1;
+        return false;
+    }
 
-    // **suggested**, implement this to check in the unit test that the blist
-    // is consistent.
-    // e.g. you can check that parent pointers are correct, sizes of internal nodes are correct, ...
-    // This might help you with the debugging.
-    void validate() const { }
+    // Copies the contents of a shared node into a new node which takes its
+    // place in the live list, i.e. becomes the parent of its children and
+    // the neighbour of the adjacent leaves. The caller puts it into the slot
+    // of the original node.
+    node_base *_clone( node_base *n ) {
+        if ( n->leaf ) {
+            auto *src = _as_leaf( n );
+            node_ptr copy = _own( _new_leaf() );
+            auto *leaf = _as_leaf( copy.get() );
+            leaf->data = src->data;
+            leaf->parent = src->parent;
+            _link_leaves( src->prev, leaf );
+            _link_leaves( leaf, src->next );
+            if ( src == _first )
+                _first = leaf;
+            if ( src == _last )
+                _last = leaf;
+            return copy.release();
+        }
+        auto *src = _as_internal( n );
+        auto *in = _new_internal();
+        in->children = src->children;
+        in->counts = src->counts;
+        if constexpr ( augmented )
+            in->aggs = src->aggs;
+        in->parent = src->parent;
+        for ( auto *c : in->children ) {
+            _acquire( c );
+            c->parent = in;
+        }
+        return in;
+    }
+
+    // Makes the node in slot exclusive to this list, slot is either _root
+    // or an entry of children of a node which is already exclusive.
+    node_base *_unshare( node_base *&slot ) {
+        if ( _shared( slot ) )
+            _free_node( std::exchange( slot, _clone( slot ) ) );
+        return slot;
+    }
+
+    // Makes the path from the root to the leaf of pos exclusive, i.e. copies
+    // the nodes from the topmost shared one down. Returns pos moved to the
+    // copy of its leaf.
+    iterator _unshare_path( iterator pos ) {
+        if constexpr ( persistent ) {
+            if ( !pos._leaf )
+                return pos;
+            static_vector< node_base *, 64 > path;
+            bool shared = false;
+            for ( node_base *n = pos._leaf; n; n = n->parent ) {
+                path.push_back( n );
+                shared = shared || _shared( n );
+            }
+            if ( !shared )
+                return pos;
+            node_base **slot = &_root;
+            for ( size_t i = path.size(); i-- > 1; ) {
+                auto *in = _as_internal( _unshare( *slot ) );
+                slot = &in->children[ _child_index( in, path[ i - 1 ] ) ];
+            }
+            pos._leaf = _as_leaf( _unshare( *slot ) );
+        }
+        return pos;
+    }
+
+    // makes the whole subtree in slot exclusive
+    void _unshare_all( node_base *&slot ) {
+        if constexpr ( persistent ) {
+            if ( !slot )
+                return;
+            _unshare( slot );
+            if ( !slot->leaf )
+                for ( auto &c : _as_internal( slot )->children )
+                    _unshare_all( c );
+        }
+    }
+
+    template< typename Node >
+    static auto *_as_leaf( Node *n ) noexcept {
+        return static_cast< CopyConst< Node, leaf_node > * >( n );
+    }
+
+    template< typename Node >
+    static auto *_as_internal( Node *n ) noexcept {
+        return static_cast< CopyConst< Node, internal_node > * >( n );
+    }
+
+    static size_t _count( const node_base *n ) noexcept {
+        return n->leaf ? _as_leaf( n )->data.size() : _as_internal( n )->counts.total();
+    }
+
+    // number of elements (leaf) or children (internal node)
+    static size_t _entries( const node_base *n ) noexcept {
+        return n->leaf ? _as_leaf( n )->data.size() : _as_internal( n )->children.size();
+    }
+
+    // least number of entries of a non-root node
+    size_t _min_entries( const node_base *n ) const noexcept {
+        return n->leaf ? _min.leaf : _min.internal;
+    }
+
+    template< typename Node >
+    static Node *_first_child( Node *n ) noexcept {
+        return n->leaf ? nullptr : _as_internal( n )->children.front();
+    }
+
+    static size_t _child_index( const internal_node *p, const node_base *c ) noexcept {
+        // appends walk up along the last children
+        if ( p->children.back() == c )
+            return p->children.size() - 1;
+        auto it = std::find( p->children.begin(), p->children.end(), c );
+        assert( it != p->children.end() );
+        return it - p->children.begin();
+    }
+
+    template< typename Node >
+    static auto *_leftmost_leaf( Node *n ) noexcept {
+        while ( !n->leaf )
+            n = _as_internal( n )->children.front();
+        return _as_leaf( n );
+    }
+
+    template< typename Node >
+    static auto *_rightmost_leaf( Node *n ) noexcept {
+        while ( !n->leaf )
+            n = _as_internal( n )->children.back();
+        return _as_leaf( n );
+    }
+
+    static void _prefetch( [[maybe_unused]] const leaf_node *leaf ) noexcept {
+#if defined( __GNUC__ ) || defined( __clang__ )
+        if ( !leaf )
+            return;
+        // the size of the leaf is not read, that would already be a cache miss
+        auto *data = reinterpret_cast< const char * >( &leaf->data ); // NOLINT
+        constexpr size_t bytes = std::min( prefetch_bytes, leaf_size * sizeof( T ) );
+        for ( size_t off = 0; off < bytes; off += 64 )
+            __builtin_prefetch( data + off );
+#endif
+    }
+
+    static void _link_leaves( leaf_node *left, leaf_node *right ) noexcept {
+        if ( left )
+            left->next = right;
+        if ( right )
+            right->prev = left;
+    }
+
+    // Frees p->children[ i ], which must have been emptied, and removes it
+    // from p. Leaves are also unlinked from the leaf list.
+    void _drop_child( internal_node *p, size_t i ) noexcept {
+        node_base *c = p->children[ i ];
+        if ( c->leaf ) {
+            auto *leaf = _as_leaf( c );
+            _link_leaves( leaf->prev, leaf->next );
+            if ( leaf == _first )
+                _first = leaf->next;
+            if ( leaf == _last )
+                _last = leaf->prev;
+        }
+        _free_node( c );
+        p->children.erase( p->children.begin() + i );
+        p->counts.erase( i, i + 1 );
+        if constexpr ( augmented )
+            p->aggs.erase( p->aggs.begin() + i );
+    }
+
+    template< typename N, typename Val >
+    static base_iterator< N > _find( base_iterator< N > first, base_iterator< N > last, const Val &value ) {
+        if ( first == last )
+            return last;
+        for ( auto *leaf = first._leaf; ; leaf = leaf->next ) {
+            size_t from = leaf == first._leaf ? first._idx : 0;
+            size_t to = leaf == last._leaf ? last._idx : leaf->data.size();
+            size_t idx = to;
+            _spans( leaf->data, from, to, [&]( auto *b, auto *e ) {
+                    auto *it = idx == to ? std::find( b, e, value ) : e;
+                    if ( it != e )
+                        idx = from + ( it - b );
+                    from += e - b;
+                } );
+            if ( idx != to )
+                return base_iterator< N >( leaf, idx );
+            if ( leaf == last._leaf )
+                return last;
+        }
+    }
+
+    // Collects ranges of leaves [first, last) covering the subtree of n, each
+    // of them holding between grain and 2 * grain elements if possible.
+    template< typename Node, typename Leaf >
+    static void _parallel_chunks( Node *n, size_t grain, std::vector< std::pair< Leaf *, Leaf * > > &out ) {
+        if ( n->leaf || _count( n ) <= grain ) {
+            out.emplace_back( _leftmost_leaf( n ), _rightmost_leaf( n )->next );
+            return;
+        }
+        auto *in = _as_internal( n );
+        for ( size_t i = 0, j; i < in->children.size(); i = j ) {
+            j = i + 1;
+            if ( in->counts[ i ] > grain ) {
+                _parallel_chunks( static_cast< Node * >( in->children[ i ] ), grain, out );
+                continue;
+            }
+            for ( size_t acc = in->counts[ i ]; j < in->children.size()
+                        && acc < grain && in->counts[ j ] <= grain; ++j )
+                acc += in->counts[ j ];
+            out.emplace_back( _leftmost_leaf( static_cast< Node * >( in->children[ i ] ) ),
+                              _rightmost_leaf( in->children[ j - 1 ] )->next );
+        }
+    }
+
+    // calls fn( chunk index, first leaf, end leaf ) for every chunk in the pool,
+    // init( number of chunks ) is called before that
+    template< typename Self, typename F, typename Init = void ( * )( size_t ) >
+    static void _parallel( Self &self, thread_pool &pool, F fn, Init init = []( size_t ) { } ) {
+        using Leaf = CopyConst< Self, leaf_node >;
+        if ( !self._root ) {
+            init( 0 );
+            return;
+        }
+        size_t grain = std::max( parallel_min_grain, self._size / ( 8 * pool.size() ) );
+        std::vector< std::pair< Leaf *, Leaf * > > chunks;
+        _parallel_chunks( static_cast< CopyConst< Self, node_base > * >( self._root ), grain, chunks );
+        init( chunks.size() );
+        if ( chunks.size() == 1 ) {
+            fn( 0, chunks[ 0 ].first, chunks[ 0 ].second );
+            return;
+        }
+        task_group group( pool );
+        for ( size_t i = 0; i < chunks.size(); ++i )
+            group.run( [&fn, &chunks, i] { fn( i, chunks[ i ].first, chunks[ i ].second ); } );
+        group.wait();
+    }
+
+    template< typename Self >
+    static auto _segments_begin( Self &self ) noexcept {
+        using It = base_segment_iterator< CopyConst< Self, leaf_node > >;
+        return self._root ? It( self._first ) : It();
+    }
+
+    // calls f( first, last ) for the part of every leaf within [first, last)
+    template< typename N, typename F >
+    static void _for_each_segment( base_iterator< N > first, base_iterator< N > last, F &&f ) {
+        if ( first == last )
+            return;
+        auto *leaf = first._leaf;
+        size_t idx = first._idx;
+        for ( ; leaf != last._leaf; leaf = leaf->next, idx = 0 ) {
+            _prefetch( leaf->next );
+            _spans( leaf->data, idx, leaf->data.size(), f );
+        }
+        _spans( leaf->data, idx, last._idx, f );
+    }
+
+    // calls f( first, last ) with pointers delimiting the contiguous runs of
+    // elements [from, to) of the leaf data
+    template< typename Data, typename F >
+    static void _spans( Data &data, size_t from, size_t to, F &&f ) {
+        if constexpr ( contiguous_leaves )
+            f( data.begin() + from, data.begin() + to );
+        else
+            data.for_each_span( from, to, f );
+    }
+
+    template< typename Self >
+    static auto _begin( Self &self ) noexcept {
+        using It = std::conditional_t< std::is_const_v< Self >, const_iterator, iterator >;
+        if ( !self._root )
+            return It();
+        return It( self._first, 0 );
+    }
+
+    template< typename Self >
+    static auto _end( Self &self ) noexcept {
+        using It = std::conditional_t< std::is_const_v< Self >, const_iterator, iterator >;
+        if ( !self._root )
+            return It();
+        return It( self._last, self._last->data.size() );
+    }
+
+    // Points _first and _last to the edge leaves after the tree was rebuilt
+    // (bulk load, split, concat), the incremental operations keep them up to
+    // date themselves.
+    void _reset_edges() noexcept {
+        _first = _root ? _leftmost_leaf( _root ) : nullptr;
+        _last = _root ? _rightmost_leaf( _root ) : nullptr;
+    }
+
+    // finds the idx-th element of the subtree of n, idx < _count( n )
+    template< typename Node >
+    static auto _descend( Node *n, size_t idx ) noexcept {
+        while ( !n->leaf ) {
+            auto *in = _as_internal( n );
+            size_t i = in->counts.find( idx );
+            idx -= in->counts.before( i );
+            n = in->children[ i ];
+        }
+        return std::pair( _as_leaf( n ), idx );
+    }
+
+    // descends from the root, idx == size() gives end()
+    template< typename Self >
+    static auto _at( Self &self, size_t idx ) noexcept {
+        using It = std::conditional_t< std::is_const_v< Self >, const_iterator, iterator >;
+        if ( idx >= self._size )
+            return _end( self );
+        auto [ leaf, i ] = _descend( static_cast< CopyConst< Self, node_base > * >( self._root ), idx );
+        return It( leaf, i );
+    }
+
+    // lower_bound (Upper == false) or upper_bound of key in a list sorted by
+    // Compare, see lower_bound()
+    template< typename Compare, bool Upper, typename Self, typename K >
+    static auto _bound( Self &self, const K &key ) {
+        using It = std::conditional_t< std::is_const_v< Self >, const_iterator, iterator >;
+        Compare comp;
+        // x precedes the bound
+        auto before = [ & ]( const auto &x ) { return Upper ? !comp( key, x ) : bool( comp( x, key ) ); };
+        if ( !self._root )
+            return It();
+        auto *n = static_cast< CopyConst< Self, node_base > * >( self._root );
+        while ( !n->leaf ) {
+            auto *in = _as_internal( n );
+            auto it = std::partition_point( in->aggs.begin(), in->aggs.end(), before );
+            if ( it == in->aggs.end() )
+                return _end( self );
+            n = in->children[ it - in->aggs.begin() ];
+        }
+        auto *leaf = _as_leaf( n );
+        auto it = std::partition_point( leaf->data.begin(), leaf->data.end(), before );
+        if ( it == leaf->data.end() )
+            return _end( self );
+        return It( leaf, size_t( it - leaf->data.begin() ) );
+    }
+
+    // Moves the position idx in leaf by n elements. Climbs up only until the
+    // subtree containing the target is found and then descends into it.
+    template< typename Leaf >
+    static std::pair< Leaf *, size_t > _advance( Leaf *leaf, size_t idx, ptrdiff_t n ) noexcept {
+        ptrdiff_t off = ptrdiff_t( idx ) + n;
+        if ( n == 0 || ( off >= 0 && size_t( off ) < leaf->data.size() ) )
+            return { leaf, off };
+        CopyConst< Leaf, node_base > *node = leaf;
+        while ( ( off < 0 || size_t( off ) >= _count( node ) ) && node->parent ) {
+            auto *p = node->parent;
+            off += p->counts.before( _child_index( p, node ) );
+            node = p;
+        }
+        assert( off >= 0 && size_t( off ) <= _count( node ) );
+        if ( size_t( off ) == _count( node ) ) {
+            auto *last = _rightmost_leaf( node );
+            return { last, last->data.size() };
+        }
+        return _descend( node, off );
+    }
+
+    iterator _iterator_at( size_t idx ) noexcept { return _at( *this, idx ); }
+    const_iterator _const_iterator_at( size_t idx ) const noexcept { return _at( *this, idx ); }
+
+    // Adds an element at the front (Front) or back of the list. The ancestors
+    // of an edge leaf are the first or last children up to the root, so an
+    // element that fits into the leaf updates the count of one known child
+    // per level, the first one through the offset of the counts, and its
+    // aggregate is combined with the element instead of being recomputed.
+    // A full edge leaf goes through emplace, which splits it.
+    template< bool Front, typename... Args >
+    void _emplace_edge( Args &&...args ) {
+        leaf_node *leaf = Front ? _first : _last;
+        if ( !leaf || leaf->data.full() ) {
+            emplace( Front ? begin() : end(), std::forward< Args >( args )... );
+            return;
+        }
+        if constexpr ( persistent )
+            leaf = _unshare_path( Front ? begin() : end() )._leaf;
+        auto &data = leaf->data;
+        if constexpr ( Front )
+            data.emplace( data.begin(), std::forward< Args >( args )... );
+        else
+            data.emplace( data.end(), std::forward< Args >( args )... );
+        [[maybe_unused]] auto x = [ & ] {
+            if constexpr ( augmented )
+                return Monoid::lift( Front ? data.front() : data.back() );
+            else
+                return 0;
+        }();
+        node_base *n = leaf;
+        for ( internal_node *p = n->parent; p; n = p, p = p->parent ) {
+            size_t i = Front ? 0 : p->children.size() - 1;
+            p->counts.add( i, 1 );
+            if constexpr ( augmented )
+                p->aggs[ i ] = Front ? Monoid::combine( x, p->aggs[ i ] ) : Monoid::combine( p->aggs[ i ], x );
+        }
+        ++_size;
+    }
+
+    // position of idx-th element of leaf in the whole sequence
+    static size_t _index_of( const leaf_node *leaf, size_t idx ) noexcept {
+        const node_base *n = leaf;
+        for ( const internal_node *p = n->parent; p; n = p, p = p->parent )
+            idx += p->counts.before( _child_index( p, n ) );
+        return idx;
+    }
+
+    // Adds delta to the element counts on the path from n to the root and
+    // recomputes the aggregates along it.
+    static void _propagate( node_base *n, ptrdiff_t delta ) noexcept {
+        for ( auto *p = n->parent; p; n = p, p = p->parent ) {
+            size_t i = _child_index( p, n );
+            p->counts.add( i, delta );
+            _update( p, i );
+        }
+    }
+
+    // aggregate of the whole subtree of n
+    static auto _aggregate( const node_base *n ) noexcept {
+        if constexpr ( augmented ) {
+            auto acc = Monoid::identity();
+            if ( n->leaf ) {
+                for ( const auto &x : _as_leaf( n )->data )
+                    acc = Monoid::combine( acc, Monoid::lift( x ) );
+            } else {
+                for ( const auto &a : _as_internal( n )->aggs )
+                    acc = Monoid::combine( acc, a );
+            }
+            return acc;
+        }
+    }
+
+    // recomputes the aggregate of p->children[ i ]
+    static void _update( [[maybe_unused]] internal_node *p, [[maybe_unused]] size_t i ) noexcept {
+        if constexpr ( augmented )
+            p->aggs[ i ] = _aggregate( p->children[ i ] );
+    }
+
+    // Recomputes the aggregates of the elements [first, last) after they were
+    // changed in place. Only the subtrees overlapping the range are visited.
+    static void _refresh( [[maybe_unused]] iterator first, [[maybe_unused]] iterator last ) noexcept {
+        if constexpr ( augmented ) {
+            if ( first == last )
+                return;
+            node_base *root = first._leaf;
+            while ( root->parent )
+                root = root->parent;
+            _refresh( root, _index_of( first._leaf, first._idx ), _index_of( last._leaf, last._idx ) );
+        }
+    }
+
+    static void _refresh( node_base *n, size_t from, size_t to ) noexcept {
+        if ( n->leaf )
+            return;
+        auto *in = _as_internal( n );
+        for ( size_t i = 0, off = 0; off < to; off += in->counts[ i++ ] ) {
+            if ( off + in->counts[ i ] <= from )
+                continue;
+            _refresh( in->children[ i ], from > off ? from - off : 0,
+                      std::min( to - off, in->counts[ i ] ) );
+            _update( in, i );
+        }
+    }
+
+    // aggregate of the elements [from, to) of the subtree of n, from < to
+    template< typename M = Monoid >
+    static typename M::value_type _query( const node_base *n, size_t from, size_t to ) {
+        auto acc = M::identity();
+        if ( n->leaf ) {
+            const auto &data = _as_leaf( n )->data;
+            for ( size_t i = from; i < to; ++i )
+                acc = M::combine( acc, M::lift( data[ i ] ) );
+            return acc;
+        }
+        auto *in = _as_internal( n );
+        for ( size_t i = 0, off = 0; off < to; off += in->counts[ i++ ] ) {
+            size_t end = off + in->counts[ i ];
+            if ( end <= from )
+                continue;
+            if ( from <= off && end <= to )
+                acc = M::combine( acc, in->aggs[ i ] );
+            else
+                acc = M::combine( acc, _query( in->children[ i ], std::max( from, off ) - off,
+                                                    std::min( to, end ) - off ) );
+        }
+        return acc;
+    }
+
+    // Moves the upper half of a full leaf to a new right sibling, returns the
+    // new leaf. The number of elements in the ancestors is unchanged.
+    leaf_node *_split_leaf( leaf_node *leaf ) {
+        node_ptr right = _own( _new_leaf() );
+        auto &from = leaf->data;
+        auto &to = _as_leaf( right.get() )->data;
+        to.splice( to.end(), from, from.begin() + min_leaf, from.end() );
+        try {
+            _insert_sibling( leaf, right.get() );
+        } catch ( ... ) {
+            from.splice( from.end(), to, to.begin(), to.end() );
+            throw;
+        }
+        auto *r = _as_leaf( right.release() );
+        _link_leaves( r, leaf->next );
+        _link_leaves( leaf, r );
+        if ( leaf == _last )
+            _last = r;
+        _count_op( &blist_counters::splits );
+        return r;
+    }
+
+    internal_node *_split_internal( internal_node *node ) {
+        node_ptr right_ptr = _own( _new_internal() );
+        auto *right = _as_internal( right_ptr.get() );
+        for ( size_t i = min_fanout; i < node->children.size(); ++i ) {
+            right->children.push_back( node->children[ i ] );
+            right->counts.push_back( node->counts[ i ] );
+            node->children[ i ]->parent = right;
+        }
+        node->children.erase( node->children.begin() + min_fanout, node->children.end() );
+        node->counts.erase( min_fanout, node->counts.size() );
+        if constexpr ( augmented ) {
+            right->aggs.insert( right->aggs.end(), node->aggs.begin() + min_fanout, node->aggs.end() );
+            node->aggs.erase( node->aggs.begin() + min_fanout, node->aggs.end() );
+        }
+        try {
+            _insert_sibling( node, right );
+        } catch ( ... ) {
+            // give the children back so that the tree stays intact
+            for ( size_t i = 0; i < right->children.size(); ++i ) {
+                node->children.push_back( right->children[ i ] );
+                node->counts.push_back( right->counts[ i ] );
+                right->children[ i ]->parent = node;
+            }
+            if constexpr ( augmented )
+                node->aggs.insert( node->aggs.end(), right->aggs.begin(), right->aggs.end() );
+            right->children.clear();
+            throw;
+        }
+        right_ptr.release();
+        _count_op( &blist_counters::splits );
+        return right;
+    }
+
+    // Links `right`, which holds elements split off `left`, as the next
+    // sibling of `left`. Splits the ancestors or grows a new root as needed.
+    void _insert_sibling( node_base *left, node_base *right ) {
+        if ( !left->parent ) {
+            assert( left == _root );
+            auto *root = _new_internal();
+            root->children.push_back( left );
+            root->counts.push_back( _count( left ) + _count( right ) );
+            if constexpr ( augmented )
+                root->aggs.emplace_back( Monoid::identity() );
+            left->parent = root;
+            _root = root;
+        }
+        if ( left->parent->children.full() )
+            _split_internal( left->parent );
+
+        auto *p = left->parent;
+        size_t i = _child_index( p, left );
+        size_t moved = _count( right );
+        p->counts.add( i, -ptrdiff_t( moved ) );
+        p->children.insert( p->children.begin() + i + 1, right );
+        p->counts.insert( i + 1, moved );
+        right->parent = p;
+        if constexpr ( augmented ) {
+            p->aggs.insert( p->aggs.begin() + i + 1, _aggregate( right ) );
+            _update( p, i );
+        }
+    }
+
+    // Moves cnt entries from the end of p->children[ left_idx ] to the
+    // beginning of its right sibling, or from the beginning of the right
+    // sibling to the end of the left one if to_right is false.
+    void _shift( internal_node *p, size_t left_idx, size_t cnt, bool to_right ) {
+        node_base *left = _unshare( p->children[ left_idx ] );
+        node_base *right = _unshare( p->children[ left_idx + 1 ] );
+        size_t moved = _move_entries( left, right, cnt, to_right );
+        p->counts.shift( left_idx, to_right ? -ptrdiff_t( moved ) : ptrdiff_t( moved ) );
+        _update( p, left_idx );
+        _update( p, left_idx + 1 );
+    }
+
+    // Moves entries between neighbouring nodes as _shift does, but leaves
+    // their parents alone. Returns the number of elements moved.
+    static size_t _move_entries( node_base *left, node_base *right, size_t cnt, bool to_right ) {
+        size_t moved = 0;
+        if ( left->leaf ) {
+            auto &l = _as_leaf( left )->data;
+            auto &r = _as_leaf( right )->data;
+            if ( to_right ) {
+                r.splice( r.begin(), l, l.end() - cnt, l.end() );
+            } else {
+                l.splice( l.end(), r, r.begin(), r.begin() + cnt );
+            }
+            moved = cnt;
+        } else {
+            auto *l = _as_internal( left );
+            auto *r = _as_internal( right );
+            auto *src = to_right ? l : r;
+            auto *dst = to_right ? r : l;
+            size_t from = to_right ? src->children.size() - cnt : 0;
+            size_t at = to_right ? 0 : dst->children.size();
+            size_t counts[ Fanout ] = {};
+            for ( size_t i = 0; i < cnt; ++i ) {
+                src->children[ from + i ]->parent = dst;
+                counts[ i ] = src->counts[ from + i ];
+                moved += counts[ i ];
+            }
+            auto first = src->children.begin() + from;
+            dst->children.insert( dst->children.begin() + at, first, first + cnt );
+            dst->counts.insert( at, counts, counts + cnt );
+            src->children.erase( first, first + cnt );
+            src->counts.erase( from, from + cnt );
+            if constexpr ( augmented ) {
+                auto afrom = src->aggs.begin() + from;
+                dst->aggs.insert( dst->aggs.begin() + at, afrom, afrom + cnt );
+                src->aggs.erase( afrom, afrom + cnt );
+            }
+        }
+        return moved;
+    }
+
+    // Restores the fill invariant of n after it lost an entry by borrowing
+    // from or merging with a sibling, continues to the parent after merges.
+    // Returns whether the tree lost a level.
+    bool _rebalance( node_base *n ) {
+        while ( n != _root && _entries( n ) < _min_entries( n ) ) {
+            auto *p = n->parent;
+            size_t i = _child_index( p, n );
+            if ( i > 0 && _entries( p->children[ i - 1 ] ) > _min_entries( n ) ) {
+                _shift( p, i - 1, 1, true );
+                _count_op( &blist_counters::borrows );
+                return false;
+            }
+            if ( i + 1 < p->children.size() && _entries( p->children[ i + 1 ] ) > _min_entries( n ) ) {
+                _shift( p, i, 1, false );
+                _count_op( &blist_counters::borrows );
+                return false;
+            }
+            size_t left = i > 0 ? i - 1 : i;
+            _shift( p, left, _entries( p->children[ left + 1 ] ), false );
+            _drop_child( p, left + 1 );
+            _count_op( &blist_counters::merges );
+            n = p;
+        }
+        if ( n == _root && !n->leaf && _as_internal( n )->children.size() == 1 ) {
+            auto *root = _as_internal( n );
+            _root = root->children.front();
+            _root->parent = nullptr;
+            root->children.clear();
+            _free_node( root );
+            return true;
+        }
+        return false;
+    }
+
+    // Inserts subtree child as the i-th child of p. Unlike _insert_sibling,
+    // the elements of child are new to the tree and are added to the counts
+    // of all ancestors.
+    void _attach( internal_node *p, size_t i, node_base *child ) {
+        if ( p->children.full() ) {
+            auto *right = _split_internal( p );
+            if ( i > min_fanout ) {
+                p = right;
+                i -= min_fanout;
+            }
+        }
+        size_t cnt = _count( child );
+        p->children.insert( p->children.begin() + i, child );
+        p->counts.insert( i, cnt );
+        if constexpr ( augmented )
+            p->aggs.insert( p->aggs.begin() + i, _aggregate( child ) );
+        child->parent = p;
+        _propagate( p, cnt );
+    }
+
+    // Restores the fill invariant of two neighbouring children of p, either
+    // of which can be arbitrarily underfull, by merging or evening them out.
+    // The left node always survives. Returns whether the tree lost a level.
+    bool _fix_pair( internal_node *p, size_t i ) {
+        size_t l = _entries( p->children[ i ] );
+        size_t r = _entries( p->children[ i + 1 ] );
+        size_t min = _min_entries( p->children[ i ] );
+        if ( l >= min && r >= min )
+            return false;
+        if ( l + r <= 2 * min ) {
+            _shift( p, i, r, false );
+            _drop_child( p, i + 1 );
+            _count_op( &blist_counters::merges );
+            return _rebalance( p );
+        }
+        size_t target = ( l + r ) / 2;
+        if ( l < target )
+            _shift( p, i, target - l, false );
+        else
+            _shift( p, i, l - target, true );
+        _count_op( &blist_counters::borrows );
+        return false;
+    }
+
+    // Appends the tree of o to this tree, h and oh are the depths of the two
+    // trees. Returns the depth of the resulting tree. If this throws, both
+    // trees are left as they were: the new nodes (and in a persistent list
+    // the copies of the shared nodes along the seam and of their neighbours,
+    // which _fix_pair and _rebalance can reach) are allocated before the
+    // trees are joined.
+    size_t _join( blist &&o, size_t h, size_t oh ) {
+        if ( !o._root )
+            return h;
+        if ( !_root ) {
+            // the move takes the minimum fill of o, the caller chose ours
+            auto min = _min;
+            *this = std::move( o );
+            _min = min;
+            return oh;
+        }
+        size_t size = _size + o._size;
+        size_t depth;
+        if ( h == oh ) {
+            _unshare( _root );
+            o._unshare( o._root );
+            auto *root = _new_internal();
+            for ( auto *c : { _root, std::exchange( o._root, nullptr ) } ) {
+                root->children.push_back( c );
+                root->counts.push_back( _count( c ) );
+                if constexpr ( augmented )
+                    root->aggs.push_back( _aggregate( c ) );
+                c->parent = root;
+            }
+            _root = root;
+            depth = h + 1 - _fix_pair( root, 0 );
+        } else if ( h > oh ) {
+            o._unshare( o._root );
+            node_base *n = _unshare( _root );
+            for ( size_t d = h; d > oh + 1; --d ) {
+                auto &children = _as_internal( n )->children;
+                // the left neighbour of the next node, see _rebalance
+                if ( children.size() > 1 )
+                    _unshare( children[ children.size() - 2 ] );
+                n = _unshare( children.back() );
+            }
+            auto *p = _as_internal( n );
+            _unshare( p->children.back() );
+            node_base *root = _root;
+            _attach( p, p->children.size(), o._root );
+            node_base *other = std::exchange( o._root, nullptr );
+            bool grew = _root != root;
+            p = other->parent;
+            depth = h + grew - _fix_pair( p, p->children.size() - 2 );
+        } else {
+            _unshare( _root );
+            node_base *n = o._unshare( o._root );
+            for ( size_t d = oh; d > h + 1; --d ) {
+                auto &children = _as_internal( n )->children;
+                // the right neighbour of the next node, see _rebalance
+                if ( children.size() > 1 )
+                    o._unshare( children[ 1 ] );
+                n = o._unshare( children.front() );
+            }
+            o._unshare( _as_internal( n )->children.front() );
+            node_base *seam = std::exchange( _root, o._root );
+            try {
+                _attach( _as_internal( n ), 0, seam );
+            } catch ( ... ) {
+                _root = seam;
+                throw;
+            }
+            bool grew = _root != o._root;
+            o._root = nullptr;
+            depth = oh + grew - _fix_pair( seam->parent, 0 );
+        }
+        o._size = 0;
+        _size = size;
+        return depth;
+    }
+
+    // Detaches children [from, to) of p as a standalone tree, child_h is
+    // the depth of the children. Returns the tree and its depth. A tree of
+    // several children takes root as its root, which has to be allocated if
+    // to - from > 1.
+    std::pair< blist, size_t > _cut( internal_node *p, size_t from, size_t to, size_t child_h,
+                                     node_ptr &root ) noexcept {
+        std::pair< blist, size_t > res( std::piecewise_construct, std::tuple( _alloc ), std::tuple( 0 ) );
+        auto &[ piece, h ] = res;
+        piece._min = _min;
+        if ( from == to )
+            return res;
+        if ( to - from == 1 ) {
+            piece._root = p->children[ from ];
+            piece._size = p->counts[ from ];
+            piece._root->parent = nullptr;
+            h = child_h;
+            return res;
+        }
+        auto *in = _as_internal( root.release() );
+        for ( size_t i = from; i < to; ++i ) {
+            in->children.push_back( p->children[ i ] );
+            in->counts.push_back( p->counts[ i ] );
+            if constexpr ( augmented )
+                in->aggs.push_back( p->aggs[ i ] );
+            p->children[ i ]->parent = in;
+        }
+        piece._root = in;
+        piece._size = in->counts.total();
+        h = child_h + 1;
+        return res;
+    }
+
+    // Takes the leaves of the subtree of n into out, in order, by walking the
+    // tree rather than the leaf links. Shared leaves are copied, the other
+    // nodes are freed. If this throws, the nodes not taken yet are freed.
+    void _collect_leaves( node_ptr n, std::vector< node_ptr > &out ) {
+        if ( !n )
+            return;
+        if ( n->leaf ) {
+            if ( _shared( n.get() ) ) {
+                node_ptr copy = _own( _new_leaf() );
+                _as_leaf( copy.get() )->data = _as_leaf( n.get() )->data;
+                n = std::move( copy );
+            }
+            out.push_back( std::move( n ) );
+            return;
+        }
+        auto &children = _as_internal( n.get() )->children;
+        bool shared = _shared( n.get() );
+        for ( auto &c : children )
+            _collect_leaves( _own( shared ? _acquire( c ) : std::exchange( c, nullptr ) ), out );
+    }
+
+    // Number of nodes to spread n entries over so that nodes hold about fill
+    // entries and no node holds less than min (unless there is just one).
+    static size_t _chunks( size_t n, size_t fill, size_t min ) noexcept {
+        size_t k = ( n + fill - 1 ) / fill;
+        while ( k > 1 && n / k < min )
+            --k;
+        return k;
+    }
+
+    // number of entries of the i-th of k nodes sharing n entries
+    static size_t _chunk_size( size_t n, size_t k, size_t i ) noexcept {
+        return n / k + ( i < n % k ? 1 : 0 );
+    }
+
+    // expects an empty blist
+    template< typename It >
+    void _bulk_load( It first, It last ) {
+        using category = typename std::iterator_traits< It >::iterator_category;
+        std::vector< node_ptr > level;
+        size_t size = 0;
+
+        if constexpr ( std::is_base_of_v< std::forward_iterator_tag, category > ) {
+            size = std::distance( first, last );
+            if ( size == 0 )
+                return;
+            size_t k = _chunks( size, leaf_fill, min_leaf );
+            level.reserve( k );
+            for ( size_t i = 0; i < k; ++i ) {
+                level.push_back( _own( _new_leaf() ) );
+                auto &data = _as_leaf( level.back().get() )->data;
+                for ( size_t j = _chunk_size( size, k, i ); j > 0; --j, ++first )
+                    data.emplace_back( *first );
+            }
+        } else {
+            for ( ; first != last; ++first, ++size ) {
+                if ( level.empty() || _as_leaf( level.back().get() )->data.size() == leaf_fill )
+                    level.push_back( _own( _new_leaf() ) );
+                _as_leaf( level.back().get() )->data.emplace_back( *first );
+            }
+            if ( size == 0 )
+                return;
+            _fix_tail( level );
+        }
+
+        for ( size_t i = 1; i < level.size(); ++i )
+            _link_leaves( _as_leaf( level[ i - 1 ].get() ), _as_leaf( level[ i ].get() ) );
+        while ( level.size() > 1 )
+            level = _build_level( level );
+        _root = level.front().release();
+        _size = size;
+        _reset_edges();
+    }
+
+    // The last leaf of a single-pass bulk load can be underfull, redistribute
+    // the elements of the last two leaves.
+    static void _fix_tail( std::vector< node_ptr > &level ) {
+        if ( level.size() < 2 )
+            return;
+        auto &l = _as_leaf( level[ level.size() - 2 ].get() )->data;
+        auto &r = _as_leaf( level.back().get() )->data;
+        if ( r.size() >= min_leaf )
+            return;
+        size_t total = l.size() + r.size();
+        if ( total <= leaf_size ) {
+            l.splice( l.end(), r, r.begin(), r.end() );
+            level.pop_back();
+            return;
+        }
+        size_t cnt = total / 2 - r.size();
+        r.splice( r.begin(), l, l.end() - cnt, l.end() );
+    }
+
+    // Groups children under parents holding about fill of them each. If this
+    // throws, children get their nodes back.
+    std::vector< node_ptr > _build_level( std::vector< node_ptr > &children, size_t fill = fanout_fill,
+                                          size_t min = min_fanout ) {
+        size_t k = _chunks( children.size(), fill, min );
+        std::vector< node_ptr > parents;
+        parents.reserve( k );
+        try {
+            for ( size_t i = 0, c = 0; i < k; ++i ) {
+                parents.push_back( _own( _new_internal() ) );
+                auto *p = _as_internal( parents.back().get() );
+                for ( size_t j = _chunk_size( children.size(), k, i ); j > 0; --j, ++c ) {
+                    size_t cnt = _count( children[ c ].get() );
+                    children[ c ]->parent = p;
+                    p->children.push_back( children[ c ].release() );
+                    p->counts.push_back( cnt );
+                    if constexpr ( augmented )
+                        p->aggs.push_back( _aggregate( p->children.back() ) );
+                }
+            }
+        } catch ( ... ) {
+            size_t c = 0;
+            for ( auto &p : parents ) {
+                for ( auto *child : _as_internal( p.get() )->children )
+                    children[ c++ ] = _own( child );
+                _as_internal( p.get() )->children.clear();
+            }
+            throw;
+        }
+        return parents;
+    }
+
+    // subtree owning n, with the aggregate computed from its contents
+    static subtree _subtree( node_ptr n ) {
+        if constexpr ( augmented ) {
+            auto agg = _aggregate( n.get() );
+            return { std::move( n ), std::move( agg ) };
+        } else
+            return { std::move( n ), {} };
+    }
+
+    // Takes over the i-th child of in with its stored aggregate. The slot is
+    // left empty, the caller clears in afterwards.
+    subtree _detach( internal_node *in, size_t i ) {
+        if constexpr ( augmented ) {
+            auto agg = in->aggs[ i ];
+            return { _own( std::exchange( in->children[ i ], nullptr ) ), std::move( agg ) };
+        } else
+            return { _own( std::exchange( in->children[ i ], nullptr ) ), {} };
+    }
+
+    // Appends s to out when apply_batch salvages the nodes after a throw. If
+    // even that fails, s is freed by its owner.
+    static void _salvage( std::vector< subtree > &out, subtree &&s ) noexcept {
+        if ( !s.node )
+            return;
+        try {
+            out.push_back( std::move( s ) );
+        } catch ( ... ) {
+        }
+    }
+
+    // appends s as the last child of p
+    static void _adopt( internal_node *p, subtree &&s ) {
+        node_base *c = s.node.release();
+        p->children.push_back( c );
+        p->counts.push_back( _count( c ) );
+        if constexpr ( augmented )
+            p->aggs.push_back( std::move( s.agg ) );
+        c->parent = p;
+    }
+
+    node_base *_unshare( subtree &s ) {
+        if ( _shared( s.node.get() ) )
+            s.node = _own( _clone( s.node.get() ) );
+        return s.node.get();
+    }
+
+    // Applies the edits [first, last) to the subtree in slot, whose first
+    // element is at position base, for apply_batch. The subtree is taken out
+    // of slot and the nodes replacing it, of the same height, are appended to
+    // out. There can be none of them, a lone one can be underfull (see
+    // _mend). buf is scratch space for the contents of the leaves. If this
+    // throws, out gets what is left of the subtree instead, in order, as
+    // subtrees of any height, some of them possibly empty.
+    void _apply_edits( node_base *&slot, edit *first, edit *last, size_t base,
+                       std::vector< subtree > &out, std::vector< T > &buf ) {
+        _unshare( slot );
+        node_ptr self = _own( std::exchange( slot, nullptr ) );
+        if ( self->leaf ) {
+            try {
+                _rewrite_leaf( self, first, last, base, out, buf );
+            } catch ( ... ) {
+                _salvage( out, _subtree( std::move( self ) ) );
+                throw;
+            }
+            return;
+        }
+
+        auto *in = _as_internal( self.get() );
+        std::vector< subtree > level, parents;
+        try {
+            level.reserve( in->children.size() );
+            size_t from = base;
+            for ( size_t i = 0; i < in->children.size(); ++i ) {
+                size_t to = from + in->counts[ i ];
+                // inserts at the end of the subtree go to the last child
+                edit *stop = i + 1 == in->children.size() ? last
+                        : std::partition_point( first, last, [ & ]( const edit &e ) { return e.pos < to; } );
+                if ( first == stop ) {
+                    // the slot is taken only once there is room for it
+                    level.emplace_back();
+                    level.back() = _detach( in, i );
+                } else
+                    _apply_edits( in->children[ i ], first, stop, from, level, buf );
+                first = stop;
+                from = to;
+            }
+            in->children.clear();
+            in->counts.clear();
+            if constexpr ( augmented )
+                in->aggs.clear();
+            _mend( level );
+            if ( level.empty() )
+                return;
+            parents = _regroup( level, std::move( self ) );
+            for ( auto &s : parents )
+                out.push_back( std::move( s ) );
+        } catch ( ... ) {
+            // the subtrees done, the children not reached yet, and the
+            // parents not yet passed on
+            for ( auto &s : level )
+                _salvage( out, std::move( s ) );
+            if ( self ) {
+                for ( size_t i = 0; i < in->children.size(); ++i ) {
+                    if ( in->children[ i ] )
+                        _salvage( out, _detach( in, i ) );
+                }
+            }
+            for ( auto &s : parents )
+                _salvage( out, std::move( s ) );
+            throw;
+        }
+    }
+
+    // The leaf part of _apply_edits. A leaf whose elements still fit into it
+    // keeps those before the first edit in place, otherwise its elements are
+    // spread over as many leaves as bulk loading would use. The new leaves
+    // and the room in out and buf are allocated before any element moves,
+    // self is taken only if nothing throws.
+    void _rewrite_leaf( node_ptr &self, edit *first, edit *last, size_t base,
+                        std::vector< subtree > &out, std::vector< T > &buf ) {
+        auto *leaf = _as_leaf( self.get() );
+        auto &data = leaf->data;
+        size_t size = data.size();
+        for ( edit *e = first; e != last; ++e )
+            size = e->kind == edit::insert ? size + 1 : size - 1;
+        size_t k = size <= leaf_size ? 1 : _chunks( size, leaf_fill, min_leaf );
+        size_t keep = k == 1 ? first->pos - base : 0;
+
+        std::vector< node_ptr > fresh;
+        fresh.reserve( k - 1 );
+        for ( size_t j = 1; j < k; ++j )
+            fresh.push_back( _own( _new_leaf() ) );
+        out.reserve( out.size() + k );
+        buf.clear();
+        buf.reserve( size - keep );
+        size_t i = keep;
+        // an insert can follow the erase at its position
+        auto move_to = [ & ]( size_t to ) {
+            if ( i >= to )
+                return;
+            buf.insert( buf.end(), std::make_move_iterator( data.begin() + i ),
+                                   std::make_move_iterator( data.begin() + to ) );
+            i = to;
+        };
+        for ( ; first != last; ++first ) {
+            move_to( first->pos - base );
+            if ( first->kind == edit::insert )
+                buf.push_back( std::move( first->value ) );
+            else {
+                assert( i == first->pos - base && i < data.size() );
+                ++i;
+            }
+        }
+        move_to( data.size() );
+        data.erase( data.begin() + keep, data.end() );
+
+        leaf_node *prev = leaf->prev;
+        leaf_node *next = leaf->next;
+        auto it = std::make_move_iterator( buf.begin() );
+        for ( size_t j = 0; j < k && size > 0; ++j ) {
+            node_ptr n = j == 0 ? std::move( self ) : std::move( fresh[ j - 1 ] );
+            auto *l = _as_leaf( n.get() );
+            size_t cnt = _chunk_size( size, k, j ) - l->data.size();
+            l->data.insert( l->data.end(), it, it + cnt );
+            it += cnt;
+            _link_leaves( prev, l );
+            prev = l;
+            out.push_back( _subtree( std::move( n ) ) );
+            if ( j > 0 )
+                _count_op( &blist_counters::splits );
+        }
+        _link_leaves( prev, next );
+    }
+
+    // Fixes the underfull nodes of level, neighbouring subtrees of the same
+    // height, by merging them with or evening them out with a neighbour.
+    // The children moved between two internal nodes meet their new
+    // neighbours at a seam, which is mended the same way one level lower.
+    // A node alone in its level can stay underfull, it is mended together
+    // with the level of its parent. Only such a lone child can be underfull
+    // within a node, which is what keeps the mending local to the seams.
+    void _mend( std::vector< subtree > &level ) {
+        for ( size_t i = 0; i < level.size() && level.size() > 1; ) {
+            node_base *n = level[ i ].node.get();
+            if ( _entries( n ) >= _min_entries( n ) ) {
+                ++i;
+                continue;
+            }
+            size_t l = i + 1 < level.size() ? i : i - 1;
+            node_base *a = _unshare( level[ l ] );
+            node_base *b = _unshare( level[ l + 1 ] );
+            size_t na = _entries( a );
+            size_t nb = _entries( b );
+            if ( na + nb <= ( a->leaf ? leaf_size : fanout ) ) {
+                _move_entries( a, b, nb, false );
+                if ( a->leaf )
+                    _link_leaves( _as_leaf( a ), _as_leaf( b )->next );
+                else
+                    _mend_seam( _as_internal( a ), na );
+                level.erase( level.begin() + l + 1 );
+                _count_op( &blist_counters::merges );
+            } else {
+                size_t target = ( na + nb ) / 2;
+                if ( na < target ) {
+                    _move_entries( a, b, target - na, false );
+                    if ( !a->leaf )
+                        _mend_seam( _as_internal( a ), na );
+                } else {
+                    _move_entries( a, b, na - target, true );
+                    if ( !b->leaf )
+                        _mend_seam( _as_internal( b ), na - target );
+                }
+                if constexpr ( augmented )
+                    level[ l + 1 ].agg = _aggregate( b );
+                _count_op( &blist_counters::borrows );
+            }
+            if constexpr ( augmented )
+                level[ l ].agg = _aggregate( a );
+            // the seam can have taken an entry of a or b
+            i = l;
+        }
+    }
+
+    // Mends the children of in after _mend moved entries into it, seam is
+    // the index of the first child on the right side of the seam.
+    void _mend_seam( internal_node *in, size_t seam ) {
+        auto full = [ & ]( size_t j ) { return _entries( in->children[ j ] ) >= _min_entries( in->children[ j ] ); };
+        if ( full( seam - 1 ) && full( seam ) )
+            return;
+        std::vector< subtree > level;
+        level.reserve( in->children.size() );
+        for ( size_t j = 0; j < in->children.size(); ++j )
+            level.push_back( _detach( in, j ) );
+        in->children.clear();
+        in->counts.clear();
+        if constexpr ( augmented )
+            in->aggs.clear();
+        // merges only, so the children fit back into in if _mend throws
+        try {
+            _mend( level );
+        } catch ( ... ) {
+            for ( auto &s : level )
+                _adopt( in, std::move( s ) );
+            throw;
+        }
+        for ( auto &s : level )
+            _adopt( in, std::move( s ) );
+    }
+
+    // Groups level under as few parents as possible, evenly spread if more
+    // than one is needed. reuse, if not null, becomes the first parent. The
+    // parents are allocated first, if that throws, level is left as it was.
+    std::vector< subtree > _regroup( std::vector< subtree > &level, node_ptr reuse ) {
+        size_t k = level.size() <= fanout ? 1 : _chunks( level.size(), fanout_fill, min_fanout );
+        std::vector< node_ptr > fresh;
+        fresh.reserve( k );
+        fresh.push_back( reuse ? std::move( reuse ) : _own( _new_internal() ) );
+        while ( fresh.size() < k )
+            fresh.push_back( _own( _new_internal() ) );
+        std::vector< subtree > parents;
+        parents.reserve( k );
+        for ( size_t i = 0, c = 0; i < k; ++i ) {
+            node_ptr p = std::move( fresh[ i ] );
+            for ( size_t j = _chunk_size( level.size(), k, i ); j > 0; --j, ++c )
+                _adopt( _as_internal( p.get() ), std::move( level[ c ] ) );
+            parents.push_back( _subtree( std::move( p ) ) );
+            if ( i > 0 )
+                _count_op( &blist_counters::splits );
+        }
+        return parents;
+    }
+
+    static void _stats( const node_base *n, blist_stats &s ) noexcept {
+        size_t capacity = n->leaf ? leaf_size : fanout;
+        size_t bucket = std::min( _entries( n ) * blist_stats::buckets / capacity, blist_stats::buckets - 1 );
+        if ( n->leaf ) {
+            ++s.leaves;
+            ++s.leaf_occupancy[ bucket ];
+            return;
+        }
+        ++s.internal_nodes;
+        ++s.internal_occupancy[ bucket ];
+        for ( auto *c : _as_internal( n )->children )
+            _stats( c, s );
+    }
+
+    size_t _validate( const node_base *n, size_t depth, const leaf_node *&last ) const {
+        assert( depth >= 1 );
+        if ( n->leaf ) {
+            assert( depth == 1 );
+            assert( _as_leaf( n )->prev == last );
+            assert( !last || last->next == n );
+            last = _as_leaf( n );
+            assert( n == _root || _entries( n ) >= _min.leaf );
+            assert( !_as_leaf( n )->data.empty() );
+            return _as_leaf( n )->data.size();
+        }
+        auto *in = _as_internal( n );
+        assert( in->children.size() == in->counts.size() );
+        assert( in->children.size() >= ( n == _root ? 2 : _min.internal ) );
+        size_t total = 0;
+        for ( size_t i = 0; i < in->children.size(); ++i ) {
+            assert( in->children[ i ]->parent == in );
+            assert( _validate( in->children[ i ], depth - 1, last ) == in->counts[ i ] );
+            total += in->counts[ i ];
+            if constexpr ( augmented ) {
+                assert( in->aggs.size() == in->children.size() );
+                if constexpr ( is_comparable< typename Monoid::value_type >::value )
+                    assert( in->aggs[ i ] == _aggregate( in->children[ i ] ) );
+            }
+        }
+        assert( total == in->counts.total() );
+        return total;
+    }
 };
+
+// blist allocating its nodes from a std::pmr::memory_resource, e.g. node_pool
+template< typename T, uint32_t LeafCapacity = blist_default_leaf_capacity< T >,
+          uint32_t Fanout = blist_default_fanout, typename Monoid = void >
+using pmr_blist = blist< T, LeafCapacity, Fanout, Monoid, std::pmr::polymorphic_allocator< T > >;
+
+// blist allocating its nodes from a node_pool of its own (shared with the
+// lists split off it and its snapshots), see pool_allocator
+template< typename T, uint32_t LeafCapacity = blist_default_leaf_capacity< T >,
+          uint32_t Fanout = blist_default_fanout, typename Monoid = void >
+using pooled_blist = blist< T, LeafCapacity, Fanout, Monoid, pool_allocator< T > >;
+
+// blist with static_deque leaves, for deque-like use with inserts and
+// erases at the front of the leaves
+template< typename T, uint32_t LeafCapacity = blist_default_leaf_capacity< T >,
+          uint32_t Fanout = blist_default_fanout, typename Monoid = void,
+          typename Allocator = std::allocator< T > >
+using deque_blist = blist< T, LeafCapacity, Fanout, Monoid, Allocator, false, false, static_deque >;
+
+// blist sharing its nodes with O(1) snapshots, see blist
+template< typename T, uint32_t LeafCapacity = blist_default_leaf_capacity< T >,
+          uint32_t Fanout = blist_default_fanout, typename Monoid = void,
+          typename Allocator = std::allocator< T > >
+using persistent_blist = blist< T, LeafCapacity, Fanout, Monoid, Allocator, true >;
+
+// Sorted multiset with positional access: a blist keeping the maximum key of
+// every child in its internal nodes (see max_key_monoid), which gives
+// lower_bound, upper_bound, insert_sorted and erase_value in O(log n) next
+// to the indexing of blist.
+template< typename T, typename Compare = std::less<>,
+          uint32_t LeafCapacity = blist_default_leaf_capacity< T >,
+          uint32_t Fanout = blist_default_fanout, typename Allocator = std::allocator< T > >
+using ordered_blist = blist< T, LeafCapacity, Fanout, max_key_monoid< T, Compare >, Allocator >;
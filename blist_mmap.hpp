@@ -0,0 +1,242 @@
+#pragma once
+
+// conditionally define assert so we can override it with RC_ASSERT for tests
+#ifndef assert
+#include <cassert>
+#endif
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// File format of a blist of trivially copyable elements, written by
+// save_blist() and mapped by mapped_blist:
+//
+//   header   blist_file_header
+//   leaves   uint32_t element count of every leaf, in order
+//   payload  byte images of the elements of every leaf, one leaf after
+//            another, starting at payload_offset (aligned to a cache line)
+//
+// The payload is the elements exactly as they are kept in the leaves, so the
+// mapping can be read in place and the element at index i sits at i elements
+// after payload_offset. The leaf directory keeps the shape of the list, it is
+// what the segments of a mapped_blist are. The file is only readable on
+// a platform with the same endianness and element layout.
+struct blist_file_header {
+    static constexpr char magic_bytes[ 8 ] = { 'b', 'l', 'i', 's', 't', '\0', '\r', '\n' };
+    static constexpr uint32_t current_version = 1;
+    static constexpr uint32_t byte_order_mark = 0x01020304;
+
+    char magic[ 8 ];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t element_size;
+    uint64_t element_align;
+    uint64_t size;           // number of elements
+    uint64_t leaves;         // number of entries of the leaf directory
+    uint64_t payload_offset; // from the start of the file
+};
+
+struct blist_file_error : std::runtime_error
+{
+    using std::runtime_error::runtime_error;
+};
+
+// Writes list (a blist or a blist snapshot) to out in the format above. The
+// leaves are written as they are, in O(n) byte copies.
+template< typename List >
+void save_blist( std::ostream &out, const List &list ) {
+    using T = typename List::value_type;
+    static_assert( std::is_trivially_copyable_v< T >, "only trivially copyable elements can be mapped" );
+    constexpr size_t payload_align = std::max< size_t >( 64, alignof( T ) );
+
+    std::vector< uint32_t > leaves;
+    list.for_each_segment( [&]( const T *b, const T *e ) { leaves.push_back( uint32_t( e - b ) ); } );
+
+    blist_file_header h;
+    std::memcpy( h.magic, blist_file_header::magic_bytes, sizeof( h.magic ) );
+    h.version = blist_file_header::current_version;
+    h.byte_order = blist_file_header::byte_order_mark;
+    h.element_size = sizeof( T );
+    h.element_align = alignof( T );
+    h.size = list.size();
+    h.leaves = leaves.size();
+    size_t dir_end = sizeof( h ) + leaves.size() * sizeof( uint32_t );
+    h.payload_offset = ( dir_end + payload_align - 1 ) / payload_align * payload_align;
+
+    static const char zeros[ payload_align ] = {};
+    out.write( reinterpret_cast< const char * >( &h ), sizeof( h ) ); // NOLINT
+    out.write( reinterpret_cast< const char * >( leaves.data() ), // NOLINT
+               std::streamsize( leaves.size() * sizeof( uint32_t ) ) );
+    out.write( zeros, std::streamsize( h.payload_offset - dir_end ) );
+    list.for_each_segment( [&]( const T *b, const T *e ) {
+            out.write( reinterpret_cast< const char * >( b ), std::streamsize( ( e - b ) * sizeof( T ) ) ); // NOLINT
+        } );
+    if ( !out )
+        throw blist_file_error( "blist: writing the file failed" );
+}
+
+// Read-only view of a file written by save_blist. The file is mapped into
+// memory and the elements are read straight from the mapping, so opening
+// it costs O(number of leaves) to check the directory, independently of the
+// size of the elements. The elements are contiguous in the mapping, which
+// gives O(1) indexing and pointer iterators. A mutable copy can be built
+// with the range constructor of blist.
+template< typename T >
+class mapped_blist
+{
+    static_assert( std::is_trivially_copyable_v< T >, "only trivially copyable elements can be mapped" );
+
+    void *_map = nullptr;
+    size_t _map_size = 0;
+    const uint32_t *_leaves = nullptr;
+    size_t _leaf_count = 0;
+    const T *_data = nullptr;
+    size_t _size = 0;
+
+  public:
+    using value_type = T;
+    using size_type = size_t;
+    using difference_type = ptrdiff_t;
+    using reference = const T &;
+    using const_reference = const T &;
+    using iterator = const T *;
+    using const_iterator = const T *;
+    using reverse_iterator = std::reverse_iterator< const_iterator >;
+    using const_reverse_iterator = std::reverse_iterator< const_iterator >;
+
+    mapped_blist() noexcept = default;
+
+    explicit mapped_blist( const std::string &path ) {
+        int fd = ::open( path.c_str(), O_RDONLY | O_CLOEXEC );
+        if ( fd < 0 )
+            throw std::system_error( errno, std::generic_category(), "blist: cannot open " + path );
+        struct stat st;
+        if ( ::fstat( fd, &st ) != 0 ) {
+            int err = errno;
+            ::close( fd );
+            throw std::system_error( err, std::generic_category(), "blist: cannot stat " + path );
+        }
+        _map_size = size_t( st.st_size );
+        if ( _map_size > 0 )
+            _map = ::mmap( nullptr, _map_size, PROT_READ, MAP_SHARED, fd, 0 );
+        int err = errno;
+        ::close( fd );
+        if ( _map == MAP_FAILED ) {
+            _map = nullptr;
+            throw std::system_error( err, std::generic_category(), "blist: cannot map " + path );
+        }
+        try {
+            _parse();
+        } catch ( ... ) {
+            _unmap();
+            throw;
+        }
+    }
+
+    mapped_blist( mapped_blist &&o ) noexcept { _swap( o ); }
+
+    mapped_blist &operator=( mapped_blist &&o ) noexcept {
+        mapped_blist tmp( std::move( o ) );
+        _swap( tmp );
+        return *this;
+    }
+
+    mapped_blist( const mapped_blist & ) = delete;
+    mapped_blist &operator=( const mapped_blist & ) = delete;
+
+    ~mapped_blist() { _unmap(); }
+
+    bool empty() const noexcept { return _size == 0; }
+    size_t size() const noexcept { return _size; }
+
+    const T &operator[]( size_t i ) const noexcept {
+        assert( i < _size );
+        return _data[ i ];
+    }
+
+    const T *data() const noexcept { return _data; }
+    const_iterator begin() const noexcept { return _data; }
+    const_iterator end() const noexcept { return _data + _size; }
+    const_iterator cbegin() const noexcept { return begin(); }
+    const_iterator cend() const noexcept { return end(); }
+    const_reverse_iterator rbegin() const noexcept { return const_reverse_iterator( end() ); }
+    const_reverse_iterator rend() const noexcept { return const_reverse_iterator( begin() ); }
+
+    // number of leaves of the list that was saved
+    size_t leaves() const noexcept { return _leaf_count; }
+
+    // Calls f( const T *begin, const T *end ) for the elements of every leaf
+    // of the list that was saved, in order.
+    template< typename F >
+    void for_each_segment( F &&f ) const {
+        const T *p = _data;
+        for ( size_t i = 0; i < _leaf_count; ++i ) {
+            f( p, p + _leaves[ i ] );
+            p += _leaves[ i ];
+        }
+    }
+
+  private:
+    void _parse() {
+        const char *base = static_cast< const char * >( _map );
+        blist_file_header h;
+        if ( _map_size < sizeof( h ) )
+            throw blist_file_error( "blist: the file is too short" );
+        std::memcpy( &h, base, sizeof( h ) );
+        if ( std::memcmp( h.magic, blist_file_header::magic_bytes, sizeof( h.magic ) ) != 0 )
+            throw blist_file_error( "blist: not a blist file" );
+        if ( h.version != blist_file_header::current_version )
+            throw blist_file_error( "blist: unsupported file version" );
+        if ( h.byte_order != blist_file_header::byte_order_mark )
+            throw blist_file_error( "blist: the file was written with another byte order" );
+        if ( h.element_size != sizeof( T ) || h.element_align != alignof( T ) )
+            throw blist_file_error( "blist: the file holds elements of another type" );
+        size_t dir_end = sizeof( h ) + h.leaves * sizeof( uint32_t );
+        if ( h.leaves > _map_size / sizeof( uint32_t ) || dir_end > h.payload_offset
+             || h.payload_offset % alignof( T ) != 0 || h.payload_offset > _map_size
+             || h.size > ( _map_size - h.payload_offset ) / sizeof( T ) )
+            throw blist_file_error( "blist: the file is truncated or corrupted" );
+
+        _leaves = reinterpret_cast< const uint32_t * >( base + sizeof( h ) ); // NOLINT
+        _leaf_count = h.leaves;
+        size_t total = 0;
+        for ( size_t i = 0; i < _leaf_count; ++i ) {
+            if ( _leaves[ i ] == 0 )
+                throw blist_file_error( "blist: the file is truncated or corrupted" );
+            total += _leaves[ i ];
+        }
+        if ( total != h.size )
+            throw blist_file_error( "blist: the file is truncated or corrupted" );
+        _data = reinterpret_cast< const T * >( base + h.payload_offset ); // NOLINT
+        _size = h.size;
+    }
+
+    void _unmap() noexcept {
+        if ( _map )
+            ::munmap( _map, _map_size );
+        _map = nullptr;
+    }
+
+    void _swap( mapped_blist &o ) noexcept {
+        std::swap( _map, o._map );
+        std::swap( _map_size, o._map_size );
+        std::swap( _leaves, o._leaves );
+        std::swap( _leaf_count, o._leaf_count );
+        std::swap( _data, o._data );
+        std::swap( _size, o._size );
+    }
+};
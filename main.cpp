@@ -1,7 +1,11 @@
 void test_static_vector();
+void test_static_deque();
+void test_small_vector();
 void test_blist();
 
 int main() {
     test_static_vector();
+    test_static_deque();
+    test_small_vector();
     test_blist();
 }
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Slab allocator for blocks of a few fixed sizes, such as the leaves and
+// internal nodes of a blist. Blocks are carved out of slabs obtained from the
+// upstream resource, freed blocks are kept in a free list of their size and
+// reused by the next allocation of that size, so that allocation churn (node
+// splits and merges) never reaches the upstream resource after the pool has
+// grown to its working size. Blocks are never returned to upstream one by
+// one, the slabs are released all at once by release() or by the destructor,
+// or by trim() once none of their blocks is in use.
+//
+// The pool is not synchronized, it must not be used from several threads at
+// once (the same as std::pmr::unsynchronized_pool_resource).
+class node_pool : public std::pmr::memory_resource
+{
+    struct free_block {
+        free_block *next;
+    };
+
+    // all blocks of one size
+    struct bucket {
+        size_t size;
+        size_t align;
+        free_block *free = nullptr;
+        char *slab_next = nullptr; // unused part of the newest slab
+        char *slab_end = nullptr;
+    };
+
+    struct slab {
+        void *ptr;
+        size_t bytes;
+        size_t align;
+        size_t block; // size of its blocks
+    };
+
+    std::pmr::memory_resource *_upstream;
+    size_t _slab_bytes;
+    std::vector< bucket > _buckets;
+    std::vector< slab > _slabs;
+
+  public:
+    static constexpr size_t default_slab_bytes = 64 * 1024;
+
+    explicit node_pool( std::pmr::memory_resource *upstream = std::pmr::get_default_resource(),
+                        size_t slab_bytes = default_slab_bytes )
+        : _upstream( upstream ), _slab_bytes( slab_bytes )
+    { }
+
+    explicit node_pool( size_t slab_bytes )
+        : node_pool( std::pmr::get_default_resource(), slab_bytes )
+    { }
+
+    node_pool( const node_pool & ) = delete;
+    node_pool &operator=( const node_pool & ) = delete;
+
+    ~node_pool() override { release(); }
+
+    // Returns all slabs to the upstream resource. Everything allocated from
+    // the pool is freed without deallocating the blocks one by one.
+    void release() noexcept {
+        for ( auto &s : _slabs )
+            _upstream->deallocate( s.ptr, s.bytes, s.align );
+        _slabs.clear();
+        _buckets.clear();
+    }
+
+    // Returns the slabs none of whose blocks are in use to the upstream
+    // resource, e.g. after the lists using the pool shrank. The free blocks
+    // are counted per slab, which takes O(f log s) for f free blocks in s
+    // slabs.
+    void trim() {
+        auto less = std::less< const char * >();
+        std::sort( _slabs.begin(), _slabs.end(), [&]( const slab &a, const slab &b ) {
+                return less( static_cast< const char * >( a.ptr ), static_cast< const char * >( b.ptr ) );
+            } );
+        auto slab_of = [&]( const void *p ) {
+            auto it = std::upper_bound( _slabs.begin(), _slabs.end(), static_cast< const char * >( p ),
+                                        [&]( const char *q, const slab &s ) { return less( q, static_cast< const char * >( s.ptr ) ); } );
+            return size_t( it - _slabs.begin() - 1 );
+        };
+
+        std::vector< size_t > free( _slabs.size() );
+        for ( auto &b : _buckets ) {
+            for ( free_block *f = b.free; f; f = f->next )
+                ++free[ slab_of( f ) ];
+            if ( b.slab_next != b.slab_end )
+                free[ slab_of( b.slab_next ) ] += ( b.slab_end - b.slab_next ) / b.size;
+        }
+        auto unused = [&]( const void *p ) {
+            size_t i = slab_of( p );
+            return free[ i ] == _slabs[ i ].bytes / _slabs[ i ].block;
+        };
+
+        for ( auto &b : _buckets ) {
+            free_block **link = &b.free;
+            while ( *link ) {
+                if ( unused( *link ) )
+                    *link = ( *link )->next;
+                else
+                    link = &( *link )->next;
+            }
+            if ( b.slab_next != b.slab_end && unused( b.slab_next ) )
+                b.slab_next = b.slab_end = nullptr;
+        }
+        size_t kept = 0;
+        for ( size_t i = 0; i < _slabs.size(); ++i ) {
+            auto &s = _slabs[ i ];
+            if ( free[ i ] == s.bytes / s.block )
+                _upstream->deallocate( s.ptr, s.bytes, s.align );
+            else
+                _slabs[ kept++ ] = s;
+        }
+        _slabs.resize( kept );
+    }
+
+    std::pmr::memory_resource *upstream_resource() const noexcept { return _upstream; }
+    size_t slab_bytes() const noexcept { return _slab_bytes; }
+
+    // number of bytes obtained from the upstream resource
+    size_t reserved_bytes() const noexcept {
+        size_t total = 0;
+        for ( auto &s : _slabs )
+            total += s.bytes;
+        return total;
+    }
+
+  protected:
+    void *do_allocate( size_t bytes, size_t align ) override {
+        bucket &b = _bucket( bytes, align );
+        if ( b.free )
+            return std::exchange( b.free, b.free->next );
+        if ( b.slab_next == b.slab_end )
+            _grow( b );
+        void *p = b.slab_next;
+        b.slab_next += b.size;
+        return p;
+    }
+
+    void do_deallocate( void *p, size_t bytes, size_t align ) override {
+        bucket &b = _bucket( bytes, align );
+        b.free = ::new ( p ) free_block{ b.free };
+    }
+
+    bool do_is_equal( const std::pmr::memory_resource &o ) const noexcept override {
+        return this == &o;
+    }
+
+  private:
+    // A blist uses just two block sizes, so the buckets are searched linearly.
+    bucket &_bucket( size_t bytes, size_t align ) {
+        align = std::max( align, alignof( free_block ) );
+        bytes = std::max( ( bytes + align - 1 ) / align * align, sizeof( free_block ) );
+        for ( auto &b : _buckets ) {
+            if ( b.size == bytes && b.align == align )
+                return b;
+        }
+        return _buckets.emplace_back( bucket{ bytes, align } );
+    }
+
+    void _grow( bucket &b ) {
+        size_t blocks = std::max< size_t >( 8, _slab_bytes / b.size );
+        size_t bytes = blocks * b.size;
+        void *p = _upstream->allocate( bytes, b.align );
+        try {
+            _slabs.push_back( { p, bytes, b.align, b.size } );
+        } catch ( ... ) {
+            _upstream->deallocate( p, bytes, b.align );
+            throw;
+        }
+        b.slab_next = static_cast< char * >( p );
+        b.slab_end = b.slab_next + bytes;
+    }
+};
+
+// Allocator owning a node_pool together with its copies (rebound ones
+// included), for a container which owns its pool, see pooled_blist. A copied
+// container gets a pool of its own (select_on_container_copy_construction),
+// moved and swapped ones take the pool along. Moving an allocator copies it,
+// so that a moved-from container can still allocate.
+template< typename T >
+class pool_allocator
+{
+    template< typename U >
+    friend class pool_allocator;
+
+    std::shared_ptr< node_pool > _pool;
+
+  public:
+    using value_type = T;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    explicit pool_allocator( std::pmr::memory_resource *upstream = std::pmr::get_default_resource(),
+                             size_t slab_bytes = node_pool::default_slab_bytes )
+        : _pool( std::make_shared< node_pool >( upstream, slab_bytes ) )
+    { }
+
+    pool_allocator( const pool_allocator & ) noexcept = default;
+    pool_allocator &operator=( const pool_allocator & ) noexcept = default;
+
+    template< typename U >
+    pool_allocator( const pool_allocator< U > &o ) noexcept : _pool( o._pool ) { }
+
+    T *allocate( size_t n ) {
+        return static_cast< T * >( _pool->allocate( n * sizeof( T ), alignof( T ) ) );
+    }
+
+    void deallocate( T *p, size_t n ) noexcept {
+        _pool->deallocate( p, n * sizeof( T ), alignof( T ) );
+    }
+
+    // a new pool with the same upstream resource and slab size
+    pool_allocator select_on_container_copy_construction() const {
+        return pool_allocator( _pool->upstream_resource(), _pool->slab_bytes() );
+    }
+
+    node_pool &pool() const noexcept { return *_pool; }
+
+    // no other allocator shares the pool
+    bool sole_owner() const noexcept { return _pool.use_count() == 1; }
+
+    template< typename U >
+    bool operator==( const pool_allocator< U > &o ) const noexcept { return _pool == o._pool; }
+    template< typename U >
+    bool operator!=( const pool_allocator< U > &o ) const noexcept { return _pool != o._pool; }
+};
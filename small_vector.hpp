@@ -0,0 +1,332 @@
+#pragma once
+
+#ifndef assert
+#include <cassert>
+#endif
+#include <cstddef>
+#include <utility>
+#include <type_traits>
+#include <iterator>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+#include <initializer_list>
+#include <vector>
+#include "static_vector.hpp"
+
+// Vector that keeps up to N elements inline, in a static_vector, and moves
+// them to a heap buffer when it outgrows it. From then on the buffer grows
+// geometrically (it is a std::vector). The vector stays on the heap until
+// shrink_to_fit() finds that the elements fit inline again, so that a vector
+// which oscillates around N does not allocate on every crossing.
+//
+// The interface is the one of static_vector without the members that only
+// make sense for a bounded vector (full(), try_emplace() and splice()), and
+// insertion never throws static_vector_full. Any insertion or erasure can
+// invalidate the iterators, as with std::vector.
+template< typename T, size_t N, typename Allocator = std::allocator< T > >
+class small_vector
+{
+    using _alloc_traits = std::allocator_traits< Allocator >;
+    static constexpr bool _nothrow_heap_move =
+        _alloc_traits::propagate_on_container_move_assignment::value
+        || _alloc_traits::is_always_equal::value;
+
+    static_vector< T, N > _inline;
+    std::vector< T, Allocator > _heap; // has a capacity iff the elements are in it
+
+  public:
+    using value_type = T;
+    using allocator_type = Allocator;
+    using size_type = size_t;
+    using difference_type = ptrdiff_t;
+    using reference = T &;
+    using const_reference = const T &;
+    using iterator = T *;
+    using const_iterator = const T *;
+    using reverse_iterator = std::reverse_iterator< iterator >;
+    using const_reverse_iterator = std::reverse_iterator< const_iterator >;
+
+    static constexpr size_t inline_capacity = N;
+
+    small_vector() = default;
+
+    explicit small_vector( const Allocator &alloc ) : _heap( alloc ) { }
+
+    explicit small_vector( size_type count, const Allocator &alloc = Allocator() )
+        : _heap( alloc )
+    {
+        resize( count );
+    }
+
+    small_vector( size_type count, const T &value, const Allocator &alloc = Allocator() )
+        : _heap( alloc )
+    {
+        resize( count, value );
+    }
+
+    small_vector( const small_vector &o )
+        : _heap( std::allocator_traits< Allocator >::select_on_container_copy_construction( o.get_allocator() ) )
+    {
+        insert( end(), o.begin(), o.end() );
+    }
+
+    small_vector( small_vector &&o )
+        noexcept( std::is_nothrow_move_constructible_v< T > )
+        : _inline( std::move( o._inline ) ), _heap( std::move( o._heap ) )
+    {
+        o._inline.clear();
+    }
+
+    small_vector( std::initializer_list< T > init, const Allocator &alloc = Allocator() ) // NOLINT
+        : small_vector( init.begin(), init.end(), alloc )
+    { }
+
+    template< typename InputIt, typename = typename std::iterator_traits< InputIt >::value_type >
+    small_vector( InputIt first, InputIt last, const Allocator &alloc = Allocator() ) // NOLINT
+        : _heap( alloc )
+    {
+        insert( end(), first, last );
+    }
+
+    small_vector &operator=( const small_vector &o ) {
+        if ( &o != this ) {
+            clear();
+            insert( end(), o.begin(), o.end() );
+        }
+        return *this;
+    }
+
+    // with an allocator that does not propagate and is not always equal, the
+    // heap elements may have to be moved one by one into a new buffer
+    small_vector &operator=( small_vector &&o )
+        noexcept( std::is_nothrow_move_constructible_v< T > && _nothrow_heap_move )
+    {
+        if ( &o == this )
+            return *this;
+        if ( o._on_heap() ) {
+            _inline.clear();
+            _heap = std::move( o._heap );
+            o.clear();
+        } else {
+            _release_heap();
+            _inline = std::move( o._inline );
+            o._inline.clear();
+        }
+        return *this;
+    }
+
+    small_vector &operator=( std::initializer_list< T > init ) {
+        clear();
+        insert( end(), init.begin(), init.end() );
+        return *this;
+    }
+
+    allocator_type get_allocator() const { return _heap.get_allocator(); }
+
+    iterator begin() noexcept { return _on_heap() ? _heap.data() : _inline.data(); }
+    const_iterator begin() const noexcept { return _on_heap() ? _heap.data() : _inline.data(); }
+    const_iterator cbegin() const noexcept { return begin(); }
+
+    iterator end() noexcept { return begin() + size(); }
+    const_iterator end() const noexcept { return begin() + size(); }
+    const_iterator cend() const noexcept { return end(); }
+
+    reverse_iterator rbegin() noexcept { return reverse_iterator( end() ); }
+    const_reverse_iterator rbegin() const noexcept { return const_reverse_iterator( end() ); }
+    const_reverse_iterator crbegin() const noexcept { return rbegin(); }
+
+    reverse_iterator rend() noexcept { return reverse_iterator( begin() ); }
+    const_reverse_iterator rend() const noexcept { return const_reverse_iterator( begin() ); }
+    const_reverse_iterator crend() const noexcept { return rend(); }
+
+    reference at( size_type pos ) { return _at( *this, pos ); }
+    const_reference at( size_type pos ) const { return _at( *this, pos ); }
+
+    reference operator[]( size_type pos ) noexcept { return begin()[ pos ]; }
+    const_reference operator[]( size_type pos ) const noexcept { return begin()[ pos ]; }
+
+    reference front() noexcept { return *begin(); }
+    const_reference front() const noexcept { return *begin(); }
+
+    reference back() noexcept { return *( end() - 1 ); }
+    const_reference back() const noexcept { return *( end() - 1 ); }
+
+    T *data() noexcept { return begin(); }
+    const T *data() const noexcept { return begin(); }
+
+    bool empty() const noexcept { return size() == 0; }
+    size_type size() const noexcept { return _on_heap() ? _heap.size() : _inline.size(); }
+    size_type max_size() const noexcept { return _heap.max_size(); }
+    size_type capacity() const noexcept { return _on_heap() ? _heap.capacity() : N; }
+
+    // true if the elements are in the inline storage
+    bool is_inline() const noexcept { return !_on_heap(); }
+
+    void reserve( size_type cap ) {
+        if ( _on_heap() )
+            _heap.reserve( cap );
+        else if ( cap > N )
+            _spill( cap );
+    }
+
+    // Moves the elements back to the inline storage if they fit, otherwise
+    // shrinks the heap buffer.
+    void shrink_to_fit() {
+        if ( !_on_heap() )
+            return;
+        if ( _heap.size() > N ) {
+            _heap.shrink_to_fit();
+            return;
+        }
+        try {
+            _inline.insert( _inline.end(), std::make_move_iterator( _heap.begin() ),
+                                           std::make_move_iterator( _heap.end() ) );
+        } catch ( ... ) {
+            _inline.clear();
+            throw;
+        }
+        _release_heap();
+    }
+
+    // the heap buffer is kept, as with std::vector
+    void clear() noexcept {
+        if ( _on_heap() )
+            _heap.clear();
+        else
+            _inline.clear();
+    }
+
+    template< typename... Args >
+    iterator emplace( iterator pos, Args &&...args ) {
+        size_t idx = pos - begin();
+        if ( !_on_heap() ) {
+            if ( !_inline.full() )
+                return _inline.emplace( pos, std::forward< Args >( args )... );
+            // the value is created first, args can refer to an element
+            T value( std::forward< Args >( args )... );
+            _spill( N + 1 );
+            _heap.insert( _heap.begin() + idx, std::move( value ) );
+        } else
+            _heap.emplace( _heap.begin() + idx, std::forward< Args >( args )... );
+        return _heap.data() + idx;
+    }
+
+    iterator insert( iterator pos, const T &value ) { return emplace( pos, value ); }
+    iterator insert( iterator pos, T &&value ) { return emplace( pos, std::move( value ) ); }
+
+    template< typename It, typename = typename std::iterator_traits< It >::value_type >
+    iterator insert( iterator pos, It first, It last ) {
+        size_t idx = pos - begin();
+        using category = typename std::iterator_traits< It >::iterator_category;
+        if constexpr ( !std::is_base_of_v< std::forward_iterator_tag, category > ) {
+            small_vector tmp( get_allocator() );
+            for ( ; first != last; ++first )
+                tmp.emplace_back( *first );
+            return insert( begin() + idx, std::make_move_iterator( tmp.begin() ),
+                                          std::make_move_iterator( tmp.end() ) );
+        } else {
+            size_t cnt = std::distance( first, last );
+            if ( !_on_heap() ) {
+                if ( _inline.size() + cnt <= N )
+                    return _inline.insert( pos, first, last );
+                _spill( _inline.size() + cnt );
+            }
+            _heap.insert( _heap.begin() + idx, first, last );
+            return _heap.data() + idx;
+        }
+    }
+
+    template< typename... Args >
+    void emplace_back( Args &&...args ) {
+        if ( _on_heap() )
+            _heap.emplace_back( std::forward< Args >( args )... );
+        else if ( !_inline.full() )
+            _inline.emplace_back( std::forward< Args >( args )... );
+        else {
+            T value( std::forward< Args >( args )... );
+            _spill( N + 1 );
+            _heap.push_back( std::move( value ) );
+        }
+    }
+
+    void push_back( const T &val ) { emplace_back( val ); }
+    void push_back( T &&val ) { emplace_back( std::move( val ) ); }
+
+    void pop_back() {
+        if ( _on_heap() )
+            _heap.pop_back();
+        else
+            _inline.pop_back();
+    }
+
+    void resize( size_type count ) {
+        if ( !_on_heap() && count <= N )
+            return _inline.resize( count );
+        reserve( count );
+        _heap.resize( count );
+    }
+
+    void resize( size_type count, const T &value ) {
+        if ( !_on_heap() && count <= N )
+            return _inline.resize( count, value );
+        if ( !_on_heap() && count > N ) {
+            T copy( value );
+            _spill( count );
+            return _heap.resize( count, copy );
+        }
+        _heap.resize( count, value );
+    }
+
+    iterator erase( iterator pos ) {
+        return erase( pos, pos + 1 );
+    }
+
+    iterator erase( iterator first, iterator last ) {
+        if ( !_on_heap() )
+            return _inline.erase( first, last );
+        size_t idx = first - begin();
+        _heap.erase( _heap.begin() + idx, _heap.begin() + ( last - begin() ) );
+        return _heap.data() + idx;
+    }
+
+    bool operator==( const small_vector &o ) const noexcept {
+        return std::equal( begin(), end(), o.begin(), o.end() );
+    }
+
+    bool operator!=( const small_vector &o ) const noexcept { return !(*this == o); }
+
+    bool operator<( const small_vector &o ) const noexcept {
+        return std::lexicographical_compare( begin(), end(), o.begin(), o.end() );
+    }
+
+    bool operator>( const small_vector &o ) const noexcept { return o < *this; }
+    bool operator<=( const small_vector &o ) const noexcept { return !(*this > o); }
+    bool operator>=( const small_vector &o ) const noexcept { return !(*this < o); }
+
+  private:
+    bool _on_heap() const noexcept { return _heap.capacity() != 0; }
+
+    // Moves the inline elements to a new heap buffer for at least cap
+    // elements, at least twice the inline capacity.
+    void _spill( size_t cap ) {
+        std::vector< T, Allocator > heap( _heap.get_allocator() );
+        heap.reserve( std::max( cap, 2 * N ) );
+        heap.insert( heap.end(), std::make_move_iterator( _inline.begin() ),
+                                 std::make_move_iterator( _inline.end() ) );
+        _inline.clear();
+        _heap.swap( heap );
+    }
+
+    void _release_heap() noexcept {
+        std::vector< T, Allocator > empty( _heap.get_allocator() );
+        _heap.swap( empty );
+    }
+
+    template< typename Self >
+    static auto &_at( Self &self, size_type pos ) {
+        if ( pos >= self.size() )
+            throw std::out_of_range( "small_vector: index out of range" );
+        return self.begin()[ pos ];
+    }
+};
@@ -0,0 +1,503 @@
+#pragma once
+
+#ifndef assert
+#include <cassert>
+#endif
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <type_traits>
+#include <iterator>
+#include <memory>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <initializer_list>
+#include <cstring>
+
+#include "static_vector.hpp" // is_trivially_relocatable
+
+struct static_deque_full : std::logic_error
+{
+    using std::logic_error::logic_error;
+};
+
+// Fixed-capacity double-ended queue. The elements live in a circular buffer
+// inside the object, so that insertion and removal at both ends is O(1) and
+// insertion and removal in the middle moves the elements of the shorter side
+// only. The elements form at most two contiguous runs, for_each_span gives
+// them as pointer ranges. The elements are shifted run by run, trivially
+// relocatable ones (see is_trivially_relocatable) with memmove.
+template< typename T, size_t Capacity >
+class static_deque
+{
+    static_assert( Capacity > 0, "static_deque must have a non-zero capacity" );
+    static constexpr bool _relocatable = is_trivially_relocatable_v< T >;
+    using internal_size = std::conditional_t<
+                              (Capacity <= std::numeric_limits< uint32_t >::max()),
+                              uint32_t, size_t >;
+    alignas( alignof( T ) ) char _data[ Capacity * sizeof( T ) ];
+    internal_size _head = 0; // slot of the first element
+    internal_size _size = 0;
+
+    template< typename From, typename To >
+    using CopyConst = std::conditional_t< std::is_const_v< From >, const To, To >;
+
+    template< typename Deque >
+    class base_iterator
+    {
+        friend class static_deque;
+        template< typename > friend class base_iterator;
+
+        Deque *_deque = nullptr;
+        size_t _idx = 0;
+
+        base_iterator( Deque *deque, size_t idx ) noexcept : _deque( deque ), _idx( idx ) { }
+
+      public:
+        using value_type = T;
+        using difference_type = ptrdiff_t;
+        using reference = CopyConst< Deque, T > &;
+        using pointer = CopyConst< Deque, T > *;
+        using iterator_category = std::random_access_iterator_tag;
+
+        base_iterator() noexcept = default;
+
+        // iterator -> const_iterator
+        template< typename D, typename = std::enable_if_t< std::is_const_v< Deque > && !std::is_const_v< D > > >
+        base_iterator( const base_iterator< D > &o ) noexcept : _deque( o._deque ), _idx( o._idx ) { } // NOLINT
+
+        reference operator*() const noexcept { return ( *_deque )[ _idx ]; }
+        pointer operator->() const noexcept { return &( *_deque )[ _idx ]; }
+        reference operator[]( difference_type n ) const noexcept { return ( *_deque )[ _idx + n ]; }
+
+        base_iterator &operator++() noexcept { ++_idx; return *this; }
+        base_iterator &operator--() noexcept { --_idx; return *this; }
+        base_iterator operator++( int ) noexcept { auto copy = *this; ++_idx; return copy; }
+        base_iterator operator--( int ) noexcept { auto copy = *this; --_idx; return copy; }
+        base_iterator &operator+=( difference_type n ) noexcept { _idx += n; return *this; }
+        base_iterator &operator-=( difference_type n ) noexcept { _idx -= n; return *this; }
+        base_iterator operator+( difference_type n ) const noexcept { return base_iterator( _deque, _idx + n ); }
+        base_iterator operator-( difference_type n ) const noexcept { return base_iterator( _deque, _idx - n ); }
+        friend base_iterator operator+( difference_type n, const base_iterator &it ) noexcept { return it + n; }
+
+        template< typename D >
+        difference_type operator-( const base_iterator< D > &o ) const noexcept {
+            return difference_type( _idx ) - difference_type( o._idx );
+        }
+
+        template< typename D >
+        bool operator==( const base_iterator< D > &o ) const noexcept { return _idx == o._idx; }
+        template< typename D >
+        bool operator!=( const base_iterator< D > &o ) const noexcept { return _idx != o._idx; }
+        template< typename D >
+        bool operator<( const base_iterator< D > &o ) const noexcept { return _idx < o._idx; }
+        template< typename D >
+        bool operator>( const base_iterator< D > &o ) const noexcept { return _idx > o._idx; }
+        template< typename D >
+        bool operator<=( const base_iterator< D > &o ) const noexcept { return _idx <= o._idx; }
+        template< typename D >
+        bool operator>=( const base_iterator< D > &o ) const noexcept { return _idx >= o._idx; }
+    };
+
+  public:
+    using value_type = T;
+    using size_type = size_t;
+    using difference_type = ptrdiff_t;
+    using reference = T &;
+    using const_reference = const T &;
+    using iterator = base_iterator< static_deque >;
+    using const_iterator = base_iterator< const static_deque >;
+    using reverse_iterator = std::reverse_iterator< iterator >;
+    using const_reverse_iterator = std::reverse_iterator< const_iterator >;
+
+    static_deque() noexcept = default;
+
+    explicit static_deque( size_type count ) {
+        _check_count_ctor( count );
+        _fill( [ & ] {
+            for ( ; _size < count; ++_size )
+                new ( _slot( _size ) ) T();
+        } );
+    }
+
+    static_deque( size_type count, const T &value ) {
+        _check_count_ctor( count );
+        _fill( [ & ] {
+            for ( ; _size < count; ++_size )
+                new ( _slot( _size ) ) T( value );
+        } );
+    }
+
+    static_deque( const static_deque &other )
+        noexcept( std::is_nothrow_copy_constructible_v< T > )
+    {
+        _fill( [ & ] {
+            for ( ; _size < other._size; ++_size )
+                new ( _slot( _size ) ) T( other[ _size ] );
+        } );
+    }
+
+    static_deque( static_deque &&other )
+        noexcept( std::is_nothrow_move_constructible_v< T > )
+    {
+        _fill( [ & ] {
+            for ( ; _size < other._size; ++_size )
+                new ( _slot( _size ) ) T( std::move( other[ _size ] ) );
+        } );
+        other.clear();
+    }
+
+    static_deque( std::initializer_list< T > init ) // NOLINT
+        : static_deque( init.begin(), init.end() )
+    { }
+
+    template< typename InputIt, typename = typename std::iterator_traits< InputIt >::value_type >
+    static_deque( InputIt first, InputIt last ) // NOLINT
+    {
+        _fill( [ & ] {
+            for ( ; first != last; ++first )
+                push_back( *first );
+        } );
+    }
+
+    ~static_deque()
+        noexcept( std::is_nothrow_destructible_v< T > )
+    {
+        clear();
+    }
+
+    static_deque &operator=( const static_deque &o ) {
+        if ( &o != this ) {
+            clear();
+            for ( ; _size < o._size; ++_size )
+                new ( _slot( _size ) ) T( o[ _size ] );
+        }
+        return *this;
+    }
+
+    static_deque &operator=( static_deque &&o )
+        noexcept( std::is_nothrow_move_constructible_v< T >
+                  && std::is_nothrow_destructible_v< T > )
+    {
+        if ( &o != this ) {
+            clear();
+            for ( ; _size < o._size; ++_size )
+                new ( _slot( _size ) ) T( std::move( o[ _size ] ) );
+            o.clear();
+        }
+        return *this;
+    }
+
+    static_deque &operator=( std::initializer_list< T > init ) {
+        if ( init.size() > Capacity )
+            throw static_deque_full( "static_deque: attempt to assign from too large initializer_list" );
+        clear();
+        for ( auto &v : init )
+            push_back( v );
+        return *this;
+    }
+
+    iterator begin() noexcept { return iterator( this, 0 ); }
+    const_iterator begin() const noexcept { return const_iterator( this, 0 ); }
+    const_iterator cbegin() const noexcept { return begin(); }
+
+    iterator end() noexcept { return iterator( this, _size ); }
+    const_iterator end() const noexcept { return const_iterator( this, _size ); }
+    const_iterator cend() const noexcept { return end(); }
+
+    reverse_iterator rbegin() noexcept { return reverse_iterator( end() ); }
+    const_reverse_iterator rbegin() const noexcept { return const_reverse_iterator( end() ); }
+    const_reverse_iterator crbegin() const noexcept { return rbegin(); }
+
+    reverse_iterator rend() noexcept { return reverse_iterator( begin() ); }
+    const_reverse_iterator rend() const noexcept { return const_reverse_iterator( begin() ); }
+    const_reverse_iterator crend() const noexcept { return rend(); }
+
+    reference at( size_type pos ) { return _at( *this, pos ); }
+    const_reference at( size_type pos ) const { return _at( *this, pos ); }
+
+    reference operator[]( size_type pos ) noexcept { return *_slot( pos ); }
+    const_reference operator[]( size_type pos ) const noexcept { return *_slot( pos ); }
+
+    reference front() noexcept { return *_slot( 0 ); }
+    const_reference front() const noexcept { return *_slot( 0 ); }
+
+    reference back() noexcept { return *_slot( _size - 1 ); }
+    const_reference back() const noexcept { return *_slot( _size - 1 ); }
+
+    bool empty() const noexcept { return _size == 0; }
+    bool full() const noexcept { return _size == Capacity; }
+    size_type size() const noexcept { return _size; }
+    size_type max_size() const noexcept { return Capacity; }
+    size_type capacity() const noexcept { return Capacity; }
+
+    void clear()
+        noexcept( std::is_nothrow_destructible_v< T > )
+    {
+        for_each_span( 0, _size, []( T *b, T *e ) { std::destroy( b, e ); } );
+        _head = 0;
+        _size = 0;
+    }
+
+    // Calls f( first, last ) with pointers delimiting the contiguous runs of
+    // the elements [from, to), i.e. once or twice.
+    template< typename F >
+    void for_each_span( size_t from, size_t to, F &&f ) { _for_each_span( *this, from, to, f ); }
+
+    template< typename F >
+    void for_each_span( size_t from, size_t to, F &&f ) const { _for_each_span( *this, from, to, f ); }
+
+    template< typename... Args >
+    void emplace_back( Args &&...args ) {
+        if ( full() )
+            throw static_deque_full( "static_deque: insertion into full static_deque failed" );
+        new ( _slot( _size ) ) T( std::forward< Args >( args )... );
+        ++_size;
+    }
+
+    template< typename... Args >
+    void emplace_front( Args &&...args ) {
+        if ( full() )
+            throw static_deque_full( "static_deque: insertion into full static_deque failed" );
+        size_t head = _head == 0 ? Capacity - 1 : _head - 1;
+        new ( _ptr( head ) ) T( std::forward< Args >( args )... );
+        _head = head;
+        ++_size;
+    }
+
+    void push_back( const T &val ) { emplace_back( val ); }
+    void push_back( T &&val ) { emplace_back( std::move( val ) ); }
+    void push_front( const T &val ) { emplace_front( val ); }
+    void push_front( T &&val ) { emplace_front( std::move( val ) ); }
+
+    void pop_back() {
+        std::destroy_at( &back() );
+        --_size;
+    }
+
+    void pop_front() {
+        std::destroy_at( &front() );
+        _head = _head + 1 == Capacity ? 0 : _head + 1;
+        --_size;
+    }
+
+    // Elements on the shorter side of pos are moved by one.
+    template< typename... Args >
+    iterator emplace( const_iterator pos, Args &&...args ) {
+        size_t idx = pos._idx;
+        if ( full() )
+            throw static_deque_full( "static_deque: insertion into full static_deque failed" );
+        if ( idx == _size ) {
+            emplace_back( std::forward< Args >( args )... );
+            return begin() + idx;
+        }
+        if ( idx == 0 ) {
+            emplace_front( std::forward< Args >( args )... );
+            return begin();
+        }
+        if constexpr ( _relocatable ) {
+            // the value is created first, args can refer to an element
+            alignas( T ) char tmp[ sizeof( T ) ];
+            new ( tmp ) T( std::forward< Args >( args )... );
+            if ( idx < _size - idx ) {
+                size_t head = _head == 0 ? Capacity - 1 : _head - 1;
+                _shift< false >( _head, head, idx );
+                _head = internal_size( head );
+            } else
+                _shift< true >( _wrap( idx ), _wrap( idx + 1 ), _size - idx );
+            std::memcpy( static_cast< void * >( _slot( idx ) ), tmp, sizeof( T ) );
+            ++_size;
+            return begin() + idx;
+        }
+        T value( std::forward< Args >( args )... );
+        if ( idx < _size - idx ) {
+            emplace_front( std::move( front() ) );
+            _shift< false >( _wrap( 2 ), _wrap( 1 ), idx - 1 );
+        } else {
+            emplace_back( std::move( back() ) );
+            _shift< true >( _wrap( idx ), _wrap( idx + 1 ), _size - idx - 2 );
+        }
+        ( *this )[ idx ] = std::move( value );
+        return begin() + idx;
+    }
+
+    iterator insert( const_iterator pos, const T &value ) { return emplace( pos, value ); }
+    iterator insert( const_iterator pos, T &&value ) { return emplace( pos, std::move( value ) ); }
+
+    // The new elements are added at the end nearer to pos and rotated into
+    // place, which moves the elements on that side only.
+    template< typename It, typename = typename std::iterator_traits< It >::value_type >
+    iterator insert( const_iterator pos, It first, It last ) {
+        using category = typename std::iterator_traits< It >::iterator_category;
+        if constexpr ( std::is_base_of_v< std::forward_iterator_tag, category > ) {
+            if ( _size + size_t( std::distance( first, last ) ) > Capacity )
+                throw static_deque_full( "static_deque: range insertion into full static_deque failed" );
+        }
+        size_t idx = pos._idx;
+        size_t old = _size;
+        if ( idx < _size - idx ) {
+            try {
+                for ( ; first != last; ++first )
+                    emplace_front( *first );
+            } catch ( ... ) {
+                while ( _size > old )
+                    pop_front();
+                throw;
+            }
+            size_t cnt = _size - old;
+            std::reverse( begin(), begin() + cnt );
+            std::rotate( begin(), begin() + cnt, begin() + cnt + idx );
+        } else {
+            try {
+                for ( ; first != last; ++first )
+                    emplace_back( *first );
+            } catch ( ... ) {
+                while ( _size > old )
+                    pop_back();
+                throw;
+            }
+            std::rotate( begin() + idx, begin() + old, end() );
+        }
+        return begin() + idx;
+    }
+
+    iterator erase( const_iterator pos ) { return erase( pos, pos + 1 ); }
+
+    // Elements on the shorter side of the range are moved.
+    iterator erase( const_iterator first, const_iterator last ) {
+        size_t idx = first._idx;
+        size_t cnt = last._idx - first._idx;
+        if ( cnt == 0 )
+            return begin() + idx;
+        auto destroy = []( T *b, T *e ) { std::destroy( b, e ); };
+        if ( idx < _size - idx - cnt ) {
+            if constexpr ( _relocatable )
+                for_each_span( idx, idx + cnt, destroy );
+            _shift< true >( _head, _wrap( cnt ), idx );
+            if constexpr ( !_relocatable )
+                for_each_span( 0, cnt, destroy );
+            _head = internal_size( _wrap( cnt ) );
+        } else {
+            if constexpr ( _relocatable )
+                for_each_span( idx, idx + cnt, destroy );
+            _shift< false >( _wrap( idx + cnt ), _wrap( idx ), _size - idx - cnt );
+            if constexpr ( !_relocatable )
+                for_each_span( _size - cnt, _size, destroy );
+        }
+        _size -= internal_size( cnt );
+        if ( _size == 0 )
+            _head = 0;
+        return begin() + idx;
+    }
+
+    // Moves the elements [first, last) of src (another static_deque) in front
+    // of pos.
+    void splice( const_iterator pos, static_deque &src, iterator first, iterator last ) {
+        assert( &src != this );
+        insert( pos, std::make_move_iterator( first ), std::make_move_iterator( last ) );
+        src.erase( first, last );
+    }
+
+    bool operator==( const static_deque &o ) const noexcept {
+        return std::equal( begin(), end(), o.begin(), o.end() );
+    }
+
+    bool operator!=( const static_deque &o ) const noexcept { return !(*this == o); }
+
+    bool operator<( const static_deque &o ) const noexcept {
+        return std::lexicographical_compare( begin(), end(), o.begin(), o.end() );
+    }
+
+    bool operator>( const static_deque &o ) const noexcept { return o < *this; }
+    bool operator<=( const static_deque &o ) const noexcept { return !(*this > o); }
+    bool operator>=( const static_deque &o ) const noexcept { return !(*this < o); }
+
+  private:
+    T *_ptr( size_t slot ) noexcept { return reinterpret_cast< T * >( _data ) + slot; } // NOLINT
+    const T *_ptr( size_t slot ) const noexcept { return reinterpret_cast< const T * >( _data ) + slot; } // NOLINT
+
+    // slot of the element at index idx, idx < Capacity
+    size_t _wrap( size_t idx ) const noexcept {
+        size_t slot = _head + idx;
+        return slot >= Capacity ? slot - Capacity : slot;
+    }
+
+    T *_slot( size_t idx ) noexcept { return _ptr( _wrap( idx ) ); }
+    const T *_slot( size_t idx ) const noexcept { return _ptr( _wrap( idx ) ); }
+
+    // Moves cnt elements from the slots starting at src to those starting at
+    // dst, both counted around the ring. Backward moves to higher slots,
+    // starting with the last element, so that the ranges can overlap. The
+    // elements are moved in runs which wrap around in neither range, so at
+    // most three. Trivially relocatable elements are memmoved and the source
+    // slots are then considered empty, other elements are move-assigned to
+    // the destination slots, which have to hold elements already.
+    template< bool Backward >
+    void _shift( size_t src, size_t dst, size_t cnt ) noexcept( _relocatable || std::is_nothrow_move_assignable_v< T > ) {
+        auto move = [ & ]( size_t from, size_t to, size_t n ) {
+            if constexpr ( _relocatable )
+                std::memmove( static_cast< void * >( _ptr( to ) ), static_cast< const void * >( _ptr( from ) ), n * sizeof( T ) );
+            else if constexpr ( Backward )
+                std::move_backward( _ptr( from ), _ptr( from ) + n, _ptr( to ) + n );
+            else
+                std::move( _ptr( from ), _ptr( from ) + n, _ptr( to ) );
+        };
+        if constexpr ( Backward ) {
+            // ends of the parts still to be moved, in 1..Capacity
+            size_t src_end = ( src + cnt - 1 ) % Capacity + 1;
+            size_t dst_end = ( dst + cnt - 1 ) % Capacity + 1;
+            while ( cnt > 0 ) {
+                size_t n = std::min( { cnt, src_end, dst_end } );
+                move( src_end - n, dst_end - n, n );
+                cnt -= n;
+                src_end = src_end == n ? Capacity : src_end - n;
+                dst_end = dst_end == n ? Capacity : dst_end - n;
+            }
+        } else {
+            while ( cnt > 0 ) {
+                size_t n = std::min( { cnt, Capacity - src, Capacity - dst } );
+                move( src, dst, n );
+                cnt -= n;
+                src = src + n == Capacity ? 0 : src + n;
+                dst = dst + n == Capacity ? 0 : dst + n;
+            }
+        }
+    }
+
+    template< typename Self, typename F >
+    static void _for_each_span( Self &self, size_t from, size_t to, F &f ) {
+        if ( from >= to )
+            return;
+        size_t first = self._wrap( from );
+        size_t cnt = to - from;
+        size_t run = std::min( cnt, Capacity - first );
+        f( self._ptr( first ), self._ptr( first ) + run );
+        if ( run < cnt )
+            f( self._ptr( 0 ), self._ptr( 0 ) + ( cnt - run ) );
+    }
+
+    template< typename Self >
+    static auto &_at( Self &self, size_type pos ) {
+        if ( pos >= self._size )
+            throw std::out_of_range( "static_deque: index out of range" );
+        return self[ pos ];
+    }
+
+    void _check_count_ctor( size_type count ) {
+        if ( count > Capacity )
+            throw static_deque_full( "static_deque: attempt to construct deque with count > capacity" );
+    }
+
+    // runs build, which adds elements to the empty deque, and destroys them
+    // again if it throws
+    template< typename F >
+    void _fill( F build ) {
+        try {
+            build();
+        } catch ( ... ) {
+            clear();
+            throw;
+        }
+    }
+};
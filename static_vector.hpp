@@ -10,6 +10,7 @@
 #include <iterator>
 #include <memory>
 #include <algorithm>
+#include <cstring>
 #include <limits>
 #include <optional>
 #include <stdexcept>
@@ -20,14 +21,145 @@ struct static_vector_full : std::logic_error
     using std::logic_error::logic_error;
 };
 
+// A type is trivially relocatable if moving an object to a new address and
+// destroying the original is equivalent to copying its bytes. Trivially
+// copyable types are, types such as std::unique_ptr usually are and can opt
+// in by specializing this trait. static_vector relocates such elements with
+// memmove/memcpy instead of moving them one by one.
+template< typename T >
+struct is_trivially_relocatable : std::is_trivially_copyable< T > { };
+
+template< typename T >
+inline constexpr bool is_trivially_relocatable_v = is_trivially_relocatable< T >::value;
+
+template< size_t Capacity >
+using static_vector_size = std::conditional_t<
+                               (Capacity <= std::numeric_limits< uint32_t >::max()),
+                               uint32_t, size_t >;
+
+// Storage of the elements of static_vector. For trivially copyable T the
+// special members are the implicit ones, so that a static_vector of such
+// elements is trivially copyable itself (and can be copied as bytes). Trivial
+// T are kept in an array of T, which makes the static_vector usable in
+// constant expressions; the std::in_place constructor value-initializes the
+// array, as a constant expression needs.
+template< typename T, size_t Capacity,
+          bool = std::is_trivially_copyable_v< T >, bool = std::is_trivial_v< T > >
+struct static_vector_storage;
+
 template< typename T, size_t Capacity >
-class static_vector
+struct static_vector_storage< T, Capacity, true, true >
+{
+    T _elems[ Capacity ];
+    static_vector_size< Capacity > _size = 0;
+
+    static_vector_storage() noexcept = default;
+    constexpr explicit static_vector_storage( std::in_place_t ) noexcept : _elems{} { }
+
+    constexpr T *_ptr() noexcept { return _elems; }
+    constexpr const T *_ptr() const noexcept { return _elems; }
+};
+
+template< typename T, size_t Capacity >
+struct static_vector_storage< T, Capacity, true, false >
 {
-    using internal_size = std::conditional_t<
-                              (Capacity <= std::numeric_limits< uint32_t >::max()),
-                              uint32_t, size_t >;
     alignas( alignof( T ) ) char _data[ Capacity * sizeof( T ) ];
-    internal_size _size = 0;
+    static_vector_size< Capacity > _size = 0;
+
+    static_vector_storage() noexcept = default;
+    explicit static_vector_storage( std::in_place_t ) noexcept { }
+
+    T *_ptr() noexcept { return reinterpret_cast< T * >( _data ); } // NOLINT
+    const T *_ptr() const noexcept { return reinterpret_cast< const T * >( _data ); } // NOLINT
+};
+
+template< typename T, size_t Capacity >
+struct static_vector_storage< T, Capacity, false, false > : static_vector_storage< T, Capacity, true, false >
+{
+    static constexpr bool _relocatable = is_trivially_relocatable_v< T >;
+
+    static_vector_storage() noexcept = default;
+    explicit static_vector_storage( std::in_place_t ) noexcept { }
+
+    static_vector_storage( const static_vector_storage &o )
+        noexcept( std::is_nothrow_copy_constructible_v< T > )
+    {
+        std::uninitialized_copy( o._ptr(), o._ptr() + o._size, this->_ptr() );
+        this->_size = o._size;
+    }
+
+    static_vector_storage( static_vector_storage &&o )
+        noexcept( _relocatable || std::is_nothrow_move_constructible_v< T > )
+    {
+        if constexpr ( _relocatable )
+            std::memcpy( static_cast< void * >( this->_ptr() ), o._data, o._size * sizeof( T ) );
+        else {
+            std::uninitialized_move( o._ptr(), o._ptr() + o._size, this->_ptr() );
+            std::destroy( o._ptr(), o._ptr() + o._size );
+        }
+        this->_size = std::exchange( o._size, 0 );
+    }
+
+    ~static_vector_storage()
+        noexcept( std::is_nothrow_destructible_v< T > )
+    {
+        std::destroy( this->_ptr(), this->_ptr() + this->_size );
+    }
+
+    static_vector_storage &operator=( const static_vector_storage &o )
+        noexcept( std::is_nothrow_copy_constructible_v< T >
+                  && std::is_nothrow_copy_assignable_v< T > )
+    {
+        if ( &o != this )
+            _assign( o._ptr(), o._size );
+        return *this;
+    }
+
+    static_vector_storage &operator=( static_vector_storage &&o )
+        noexcept( _relocatable || ( std::is_nothrow_move_constructible_v< T >
+                                    && std::is_nothrow_move_assignable_v< T > ) )
+    {
+        if ( &o == this )
+            return *this;
+        if constexpr ( _relocatable ) {
+            std::destroy( this->_ptr(), this->_ptr() + this->_size );
+            std::memcpy( static_cast< void * >( this->_ptr() ), o._data, o._size * sizeof( T ) );
+            this->_size = std::exchange( o._size, 0 );
+        } else {
+            _assign( std::make_move_iterator( o._ptr() ), o._size );
+            std::destroy( o._ptr(), o._ptr() + o._size );
+            o._size = 0;
+        }
+        return *this;
+    }
+
+    // assigns to the live elements, constructs or destroys the rest
+    template< typename It >
+    void _assign( It first, size_t count ) {
+        T *p = this->_ptr();
+        size_t size = this->_size;
+        std::copy( first, first + std::min( size, count ), p );
+        if ( count < size )
+            std::destroy( p + count, p + size );
+        else
+            std::uninitialized_copy( first + size, first + count, p + size );
+        this->_size = static_vector_size< Capacity >( count );
+    }
+};
+
+// Vector with a fixed capacity and the elements stored inline. Copies, moves
+// and destruction are trivial when they are trivial for T; for trivial T the
+// vector can be built and filled in constant expressions.
+template< typename T, size_t Capacity >
+class static_vector : static_vector_storage< T, Capacity >
+{
+    using _storage = static_vector_storage< T, Capacity >;
+    using _storage::_size;
+    using _storage::_ptr;
+    using internal_size = static_vector_size< Capacity >;
+
+    static constexpr bool _relocatable = is_trivially_relocatable_v< T >;
+    static constexpr bool _trivial = std::is_trivial_v< T >;
 
   public:
     using value_type = T;
@@ -42,129 +174,97 @@ class static_vector
 
     static_vector() noexcept = default;
 
-    explicit static_vector( size_type count )
-        : _size( count )
+    constexpr explicit static_vector( size_type count )
+        : _storage( std::in_place )
     {
         _check_count_ctor( count );
-        for ( auto &loc : *this )
-            new ( &loc ) T();
+        while ( _size < count )
+            _construct_back();
     }
 
-    static_vector( size_type count, const T &value )
-        : _size( count )
+    constexpr static_vector( size_type count, const T &value )
+        : _storage( std::in_place )
     {
         _check_count_ctor( count );
-        std::uninitialized_fill( begin(), end(), value );
+        while ( _size < count )
+            _construct_back( value );
     }
 
-    static_vector( const static_vector &other )
-        noexcept( std::is_nothrow_copy_constructible_v< T > )
-        : _size( other._size )
-    {
-        std::uninitialized_copy( other.begin(), other.end(), begin() );
-    }
+    static_vector( const static_vector &other ) = default;
+    static_vector( static_vector &&other ) = default;
 
-    static_vector( static_vector &&other )
-        noexcept( std::is_nothrow_move_constructible_v< T > )
-        : _size( other._size )
-    {
-        std::uninitialized_move( other.begin(), other.end(), begin() );
-        other.clear();
-    }
-
-    static_vector( std::initializer_list< T > init ) // NOLINT
+    constexpr static_vector( std::initializer_list< T > init ) // NOLINT
         : static_vector( init.begin(), init.end() )
     { }
 
     template< typename InputIt, typename = typename std::iterator_traits< InputIt >::value_type >
-    static_vector( InputIt first, InputIt last ) // NOLINT
+    constexpr static_vector( InputIt first, InputIt last ) // NOLINT
+        : _storage( std::in_place )
     {
         for ( ; first != last; ++first )
             push_back( *first );
     }
 
-    ~static_vector()
-        noexcept( std::is_nothrow_destructible_v< T > )
-    {
-        _destroy_elems();
-    }
+    ~static_vector() = default;
 
-    static_vector &operator=( const static_vector &o )
-        noexcept( std::is_nothrow_copy_constructible_v< T >
-                  && std::is_nothrow_destructible_v< T > )
-    {
-        if ( &o != this ) {
-            _set_size( o._size );
-            std::copy( o.begin(), o.end(), begin() );
-        }
-        return *this;
-    }
-
-    static_vector &operator=( static_vector &&o )
-        noexcept( std::is_nothrow_move_constructible_v< T >
-                  && std::is_nothrow_destructible_v< T > )
-    {
-        if ( &o != this ) {
-            _set_size( o._size );
-            std::move( o.begin(), o.end(), begin() );
-            o.clear();
-        }
-        return *this;
-    }
+    static_vector &operator=( const static_vector &o ) = default;
+    static_vector &operator=( static_vector &&o ) = default;
 
     static_vector &operator=( std::initializer_list< T > init )
     {
         if ( init.size() > Capacity )
             throw static_vector_full( "static_vector: attempt to assign from too large initializer_list" );
-        _set_size( init.size() );
-        std::copy( init.begin(), init.end(), begin() );
+        size_t common = std::min( init.size(), size() );
+        std::copy_n( init.begin(), common, begin() );
+        _set_size( common );
+        for ( auto it = init.begin() + common; it != init.end(); ++it )
+            _construct_back( *it );
         return *this;
     }
 
+    constexpr iterator begin() noexcept { return _ptr(); }
+    constexpr const_iterator begin() const noexcept { return _ptr(); }
+    constexpr const_iterator cbegin() const noexcept { return _ptr(); }
 
-    iterator begin() noexcept { return reinterpret_cast< T * >( _data ); } // NOLINT
-    const_iterator begin() const noexcept { return reinterpret_cast< const T * >( _data ); } // NOLINT
-    const_iterator cbegin() const noexcept { return reinterpret_cast< const T * >( _data ); } // NOLINT
-
-    iterator end() noexcept { return begin() + _size; }
-    const_iterator end() const noexcept { return begin() + _size; }
-    const_iterator cend() const noexcept { return begin() + _size; }
+    constexpr iterator end() noexcept { return begin() + _size; }
+    constexpr const_iterator end() const noexcept { return begin() + _size; }
+    constexpr const_iterator cend() const noexcept { return begin() + _size; }
 
-    reverse_iterator rbegin() noexcept { return std::reverse_iterator( end() ); }
-    const_reverse_iterator rbegin() const noexcept { return std::reverse_iterator( end() ); }
-    const_reverse_iterator crbegin() const noexcept { return std::reverse_iterator( end() ); }
+    constexpr reverse_iterator rbegin() noexcept { return std::reverse_iterator( end() ); }
+    constexpr const_reverse_iterator rbegin() const noexcept { return std::reverse_iterator( end() ); }
+    constexpr const_reverse_iterator crbegin() const noexcept { return std::reverse_iterator( end() ); }
 
-    reverse_iterator rend() noexcept { return std::reverse_iterator( begin() ); }
-    const_reverse_iterator rend() const noexcept { return std::reverse_iterator( begin() ); }
-    const_reverse_iterator crend() const noexcept { return std::reverse_iterator( begin() ); }
+    constexpr reverse_iterator rend() noexcept { return std::reverse_iterator( begin() ); }
+    constexpr const_reverse_iterator rend() const noexcept { return std::reverse_iterator( begin() ); }
+    constexpr const_reverse_iterator crend() const noexcept { return std::reverse_iterator( begin() ); }
 
-    reference at( size_type pos ) {
+    constexpr reference at( size_type pos ) {
         return _at( *this, pos );
     }
 
-    const_reference at( size_type pos ) const {
+    constexpr const_reference at( size_type pos ) const {
         return _at( *this, pos );
     }
 
-    reference operator[]( size_type pos ) noexcept { return begin()[ pos ]; }
-    const_reference operator[]( size_type pos ) const noexcept { return begin()[ pos ]; }
+    constexpr reference operator[]( size_type pos ) noexcept { return begin()[ pos ]; }
+    constexpr const_reference operator[]( size_type pos ) const noexcept { return begin()[ pos ]; }
 
-    reference front() noexcept { return *begin(); }
-    const_reference front() const noexcept { return *begin(); }
+    constexpr reference front() noexcept { return *begin(); }
+    constexpr const_reference front() const noexcept { return *begin(); }
 
-    reference back() noexcept { return *(end() - 1); }
-    const_reference back() const noexcept { return *(end() - 1); }
+    constexpr reference back() noexcept { return *(end() - 1); }
+    constexpr const_reference back() const noexcept { return *(end() - 1); }
 
-    T *data() noexcept { return begin(); }
-    const T *data() const noexcept { return begin(); }
+    constexpr T *data() noexcept { return begin(); }
+    constexpr const T *data() const noexcept { return begin(); }
 
-    bool empty() const noexcept { return _size == 0; }
-    bool full() const noexcept { return _size == Capacity; }
-    size_type size() const noexcept { return _size; }
-    size_type max_size() const noexcept { return Capacity; }
-    size_type capacity() const noexcept { return Capacity; }
+    constexpr bool empty() const noexcept { return _size == 0; }
+    constexpr bool full() const noexcept { return _size == Capacity; }
+    constexpr size_type size() const noexcept { return _size; }
+    constexpr size_type max_size() const noexcept { return Capacity; }
+    constexpr size_type capacity() const noexcept { return Capacity; }
 
-    void clear()
+    constexpr void clear()
         noexcept( std::is_nothrow_destructible_v< T > )
     {
         _destroy_elems();
@@ -176,7 +276,17 @@ class static_vector
     std::optional< iterator > try_emplace( iterator pos, Args &&...args ) {
         if ( _size == Capacity )
             return std::nullopt;
-        if ( pos != end() && _size ) {
+        if constexpr ( _relocatable ) {
+            if ( pos != end() ) {
+                // the value is created first, args can refer to an element
+                alignas( T ) char tmp[ sizeof( T ) ];
+                new ( tmp ) T( std::forward< Args >( args )... );
+                _relocate( pos, end() - pos, pos + 1 );
+                _relocate( reinterpret_cast< T * >( tmp ), 1, pos ); // NOLINT
+                ++_size;
+                return pos;
+            }
+        } else if ( pos != end() && _size ) {
             std::uninitialized_move_n( end() - 1, 1, end() );
             if ( end() - 1 > pos )
                 std::move_backward( pos, end() - 1, end() );
@@ -206,7 +316,18 @@ class static_vector
             throw static_vector_full( "static_vector: range insertion into full static_vector failed" );
 
         size_t to_end = std::distance( pos, end() );
-        if ( to_end >= size_t( dist ) ) {
+        if constexpr ( _relocatable ) {
+            _relocate( pos, to_end, pos + dist );
+            auto dst = pos;
+            try {
+                for ( ; first != last; ++first, ++dst )
+                    new ( dst ) T( *first );
+            } catch ( ... ) {
+                std::destroy( pos, dst );
+                _relocate( pos + dist, to_end, pos );
+                throw;
+            }
+        } else if ( to_end >= size_t( dist ) ) {
             std::uninitialized_move_n( end() - dist, dist, end() );
             std::move_backward( pos, end() - dist, end() );
             std::copy( first, last, pos );
@@ -228,26 +349,31 @@ class static_vector
     }
 
     template< typename... Args >
-    void emplace_back( Args &&...args ) { emplace( end(), std::forward< Args >( args )... ); }
+    constexpr void emplace_back( Args &&...args ) {
+        if ( full() )
+            throw static_vector_full( "static_vector: insertion into full static_vector failed" );
+        _construct_back( std::forward< Args >( args )... );
+    }
 
-    void push_back( const T &val ) { emplace_back( val ); }
-    void push_back( T &&val ) { emplace_back( std::move( val ) ); }
+    constexpr void push_back( const T &val ) { emplace_back( val ); }
+    constexpr void push_back( T &&val ) { emplace_back( std::move( val ) ); }
 
-    void pop_back() {
-        std::destroy_at( &back() );
+    constexpr void pop_back() {
+        if constexpr ( !_trivial )
+            std::destroy_at( &back() );
         --_size;
     }
 
     void resize( size_type count ) {
-        auto it = _resize( count );
-        for ( auto e = end(); it < e; ++it )
-            new ( it ) T();
+        _resize( count );
+        while ( _size < count )
+            _construct_back();
     }
 
     void resize( size_type count, const T &value ) {
-        auto it = _resize( count );
-        if ( it < end() )
-            std::fill( it, end(), value );
+        _resize( count );
+        while ( _size < count )
+            _construct_back( value );
     }
 
     iterator erase( iterator pos ) {
@@ -255,12 +381,38 @@ class static_vector
     }
 
     iterator erase( iterator first, iterator last ) {
+        if constexpr ( _relocatable ) {
+            std::destroy( first, last );
+            _relocate( last, end() - last, first );
+            _size -= last - first;
+            return first;
+        }
         auto it = std::move( last, end(), first );
         std::destroy( it, end() );
         _size -= last - first;
         return first;
     }
 
+    // Moves the elements [first, last) of src (another static_vector) in front
+    // of pos, e.g. the upper half of a full vector to an empty one. Trivially
+    // relocatable elements are moved with at most three memmoves.
+    void splice( iterator pos, static_vector &src, iterator first, iterator last ) {
+        assert( &src != this );
+        size_t cnt = last - first;
+        if ( _size + cnt > Capacity )
+            throw static_vector_full( "static_vector: splice into full static_vector failed" );
+        if constexpr ( _relocatable ) {
+            _relocate( pos, end() - pos, pos + cnt );
+            _relocate( first, cnt, pos );
+            _relocate( last, src.end() - last, first );
+            _size += internal_size( cnt );
+            src._size -= internal_size( cnt );
+        } else {
+            insert( pos, std::make_move_iterator( first ), std::make_move_iterator( last ) );
+            src.erase( first, last );
+        }
+    }
+
     bool operator==( const static_vector &o ) const noexcept {
         return std::equal( begin(), end(), o.begin(), o.end() );
     }
@@ -277,27 +429,46 @@ class static_vector
 
   private:
     template< typename Self >
-    static auto& _at( Self& self, size_type pos )
+    static constexpr auto& _at( Self& self, size_type pos )
     {
         if ( pos >= self._size )
             throw std::out_of_range( "static_vector: index out of range" );
         return self.begin()[ pos ];
     }
 
-    void _check_count_ctor( size_type count ) {
+    static constexpr void _check_count_ctor( size_type count ) {
         if ( count > Capacity )
             throw static_vector_full( "static_vector: attempt to construct vector with count > capacity" );
     }
 
-    iterator _resize( size_type count ) {
+    void _resize( size_type count ) {
         if ( count > Capacity )
             throw static_vector_full( "static_vector: attempt to resize vector with count > capacity" );
-        auto it = end();
-        _set_size( count );
-        return it;
+        if ( count < _size )
+            _set_size( count );
+    }
+
+    constexpr void _destroy_elems() {
+        if constexpr ( !_trivial )
+            std::destroy( begin(), end() );
     }
 
-    void _destroy_elems() { std::destroy( begin(), end() ); }
+    // constructs an element at the end, which must not be full; elements
+    // of trivial types are assigned so that it works in constant expressions
+    template< typename... Args >
+    constexpr void _construct_back( Args &&...args ) {
+        if constexpr ( _trivial )
+            begin()[ _size ] = T( std::forward< Args >( args )... );
+        else
+            new ( end() ) T( std::forward< Args >( args )... );
+        ++_size;
+    }
+
+    // moves the bytes of cnt elements from src to dst, the ranges can overlap
+    static void _relocate( const T *src, size_t cnt, T *dst ) noexcept {
+        if ( cnt > 0 )
+            std::memmove( static_cast< void * >( dst ), static_cast< const void * >( src ), cnt * sizeof( T ) );
+    }
 
     void _set_size( size_type size )
     {
@@ -5,11 +5,47 @@
 #define assert(X) RC_ASSERT(X)
 
 #include "blist.hpp"
+#include "blist_mmap.hpp"
 #include <deque>
+#include <list>
+#include <set>
 #include <variant>
 #include <cstring>
+#include <sstream>
+#include <atomic>
+#include <fstream>
+#include <unistd.h>
 
 template class blist< int >;
+template class blist< int, 8, 8, void, std::pmr::polymorphic_allocator< int > >;
+template class blist< int, 8, 8, void, pool_allocator< int > >;
+template class blist< int, 6, 4, void, std::allocator< int >, false, true >;
+template class blist< int, 8, 8, void, std::allocator< int >, false, false, static_deque >;
+
+// forwards to the new/delete resource and counts the allocations, the
+// allocation number fail_at throws bad_alloc
+struct counting_resource : std::pmr::memory_resource {
+    size_t allocs = 0;
+    size_t live = 0;
+    size_t fail_at = SIZE_MAX;
+
+    void *do_allocate( size_t bytes, size_t align ) override {
+        if ( allocs == fail_at ) {
+            fail_at = SIZE_MAX;
+            throw std::bad_alloc();
+        }
+        ++allocs;
+        ++live;
+        return std::pmr::new_delete_resource()->allocate( bytes, align );
+    }
+
+    void do_deallocate( void *p, size_t bytes, size_t align ) override {
+        --live;
+        std::pmr::new_delete_resource()->deallocate( p, bytes, align );
+    }
+
+    bool do_is_equal( const std::pmr::memory_resource &o ) const noexcept override { return this == &o; }
+};
 
 template< typename T >
 struct PushFront {
@@ -44,7 +80,7 @@ static void run( Container &c, PushBack< T > &x ) {
 template< typename... Ops >
 struct CheckOpts {
     void operator()( std::vector< std::variant< Ops... > > ops ) const {
-        blist< int, 8 > bl;
+        blist< int, 8, 8 > bl;
         std::deque< int > deq;
         size_t depth = 0;
         for ( auto &v : ops ) {
@@ -93,7 +129,7 @@ void test_blist() {
     } );
 
     rc::check( "blist push_back", []( std::vector< int > vals ) {
-        blist< int, 8 > bl;
+        blist< int, 8, 8 > bl;
         for ( auto it = vals.begin(); it != vals.end(); ++it ) {
             RC_LOG() << *it << " ";
             bl.push_back( *it );
@@ -106,16 +142,104 @@ void test_blist() {
     } );
 
     rc::check( "blist ctor iterator", []( std::vector< int > vals ) {
-        blist< int, 8 > bl( vals.begin(), vals.end() );
+        blist< int, 8, 8 > bl( vals.begin(), vals.end() );
         RC_ASSERT( bl.size() == vals.size() );
         bl.validate();
         RC_ASSERT( std::equal( vals.begin(), vals.end(), bl.begin(), bl.end() ) );
     } );
 
+    rc::check( "blist ctor input iterator", []( std::vector< int > vals ) {
+        std::stringstream ss;
+        for ( int v : vals )
+            ss << v << " ";
+        blist< int, 8, 8 > bl{ std::istream_iterator< int >( ss ), std::istream_iterator< int >() };
+        RC_ASSERT( bl.size() == vals.size() );
+        bl.validate();
+        RC_ASSERT( std::equal( vals.begin(), vals.end(), bl.begin(), bl.end() ) );
+    } );
+
+    rc::check( "blist ctor ilist", single, [] {
+        blist< int, 4, 4 > bl{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+        RC_ASSERT( bl.size() == 11u );
+        bl.validate();
+        for ( int i = 0; i <= 10; ++i )
+            RC_ASSERT( bl[ i ] == i );
+    } );
+
+    rc::check( "blist ctor iterator + push_{front,back}", []( std::vector< int > vals, std::vector< bool > front ) {
+        blist< int, 8, 8 > bl( vals.begin(), vals.end() );
+        std::deque< int > deq( vals.begin(), vals.end() );
+        for ( bool f : front ) {
+            if ( f ) {
+                bl.push_front( deq.size() );
+                deq.push_front( deq.size() );
+            } else {
+                bl.push_back( deq.size() );
+                deq.push_back( deq.size() );
+            }
+            bl.validate();
+        }
+        RC_ASSERT( std::equal( bl.begin(), bl.end(), deq.begin(), deq.end() ) );
+    } );
+
+    rc::check( "blist push at both ends", []( std::vector< std::tuple< int, int, int > > ops ) {
+        // pushes at the edges mixed with erases and lookups anywhere, which
+        // move the counts that prepends keep in the offset
+        auto run = [ & ]( auto bl, auto persistent ) {
+            std::deque< int > deq;
+            // a snapshot makes the persistent list copy the edge paths
+            auto snapshot = [ & ] {
+                if constexpr ( decltype( persistent )::value )
+                    return bl.snapshot();
+                else
+                    return 0;
+            };
+            auto snap = snapshot();
+            std::deque< int > snapped;
+            for ( auto [ op, v1, v2 ] : ops ) {
+                size_t idx = deq.empty() ? 0 : std::abs( v1 ) % deq.size();
+                switch ( std::abs( op ) % 5 ) {
+                    case 0:
+                    case 1:
+                        bl.push_front( v2 );
+                        deq.push_front( v2 );
+                        break;
+                    case 2:
+                        bl.push_back( v2 );
+                        deq.push_back( v2 );
+                        break;
+                    case 3:
+                        if ( !deq.empty() ) {
+                            bl.erase( bl.begin() + idx );
+                            deq.erase( deq.begin() + idx );
+                        }
+                        break;
+                    default:
+                        if ( !deq.empty() )
+                            RC_ASSERT( bl[ idx ] == deq[ idx ] );
+                        snap = snapshot();
+                        snapped = deq;
+                }
+                bl.validate();
+            }
+            RC_ASSERT( std::equal( bl.begin(), bl.end(), deq.begin(), deq.end() ) );
+            if constexpr ( decltype( persistent )::value )
+                RC_ASSERT( std::equal( snap.begin(), snap.end(), snapped.begin(), snapped.end() ) );
+            for ( size_t i = 0; i < deq.size(); ++i )
+                RC_ASSERT( *( bl.begin() + i ) == deq[ i ] );
+            return bl;
+        };
+        run( blist< int, 4, 4 >(), std::false_type() );
+        run( deque_blist< int, 6, 4 >(), std::false_type() );
+        run( blist< int, 4, 4, sum_monoid< long long > >(), std::false_type() );
+        auto sums = run( persistent_blist< int, 4, 4, sum_monoid< long long > >(), std::true_type() );
+        RC_ASSERT( sums.range_query( 0, sums.size() ) == std::accumulate( sums.begin(), sums.end(), 0LL ) );
+    } );
+
     rc::check( "blist iterator", []( std::vector< int > vals ) {
-        blist< int, 8 > bl( vals.begin(), vals.end() );
-        using CIt = blist< int, 8 >::const_iterator;
-        using CRIt = blist< int, 8 >::const_reverse_iterator;
+        blist< int, 8, 8 > bl( vals.begin(), vals.end() );
+        using CIt = blist< int, 8, 8 >::const_iterator;
+        using CRIt = blist< int, 8, 8 >::const_reverse_iterator;
         const auto &cbl = bl;
 
         auto fit = bl.begin();
@@ -195,7 +319,7 @@ void test_blist() {
     rc::check( "blist push_{front,back} random", CheckOpts< PushBack< int >, PushFront< int > >() );
 
     rc::check( "blist create + erases", []( std::vector< int > vals, std::vector< unsigned > idxs ) {
-        blist< int, 8 > bl( vals.begin(), vals.end() );
+        blist< int, 8, 8 > bl( vals.begin(), vals.end() );
         RC_TAG( "depth " + std::to_string( bl.depth() ) );
         for ( auto v : idxs ) {
             if ( vals.empty() )
@@ -212,7 +336,7 @@ void test_blist() {
     } );
 
     rc::check( "blist create + move", []( std::vector< int > vals ) {
-        blist< int, 8 > bl( vals.begin(), vals.end() );
+        blist< int, 8, 8 > bl( vals.begin(), vals.end() );
         auto it = bl.begin();
         auto rit = bl.rbegin();
         auto copy( std::move( bl ) );
@@ -224,4 +348,1116 @@ void test_blist() {
         RC_ASSERT( copy.begin() == it );
         RC_ASSERT( copy.rbegin() == rit );
     } );
+    rc::check( "blist split", []( std::vector< int > vals, unsigned pos ) {
+        pos %= vals.size() + 1;
+        blist< int, 4, 4 > bl( vals.begin(), vals.end() );
+        auto right = bl.split( std::next( bl.begin(), pos ) );
+        bl.validate();
+        right.validate();
+        RC_ASSERT( bl.size() == pos );
+        RC_ASSERT( right.size() == vals.size() - pos );
+        RC_ASSERT( std::equal( bl.begin(), bl.end(), vals.begin(), vals.begin() + pos ) );
+        RC_ASSERT( std::equal( right.begin(), right.end(), vals.begin() + pos, vals.end() ) );
+
+        bl.concat( std::move( right ) );
+        bl.validate();
+        right.validate();
+        RC_ASSERT( right.empty() );
+        RC_ASSERT( std::equal( bl.begin(), bl.end(), vals.begin(), vals.end() ) );
+    } );
+
+    rc::check( "blist concat", []( std::vector< int > vals1, std::vector< int > vals2, unsigned extra ) {
+        // make the depths of the trees differ
+        if ( extra % 2 )
+            vals1.resize( vals1.size() + extra % 64 * 4 );
+        else
+            vals2.resize( vals2.size() + extra % 64 * 4 );
+        blist< int, 4, 4 > bl1( vals1.begin(), vals1.end() );
+        blist< int, 4, 4 > bl2( vals2.begin(), vals2.end() );
+        RC_TAG( "depths " + std::to_string( bl1.depth() ) + " " + std::to_string( bl2.depth() ) );
+        auto bl = join( std::move( bl1 ), std::move( bl2 ) );
+        vals1.insert( vals1.end(), vals2.begin(), vals2.end() );
+        bl.validate();
+        RC_ASSERT( bl.size() == vals1.size() );
+        RC_ASSERT( std::equal( bl.begin(), bl.end(), vals1.begin(), vals1.end() ) );
+    } );
+
+    rc::check( "blist split + concat + erase", []( std::vector< int > vals, std::vector< unsigned > idxs ) {
+        blist< int, 8, 4 > bl( vals.begin(), vals.end() );
+        for ( auto v : idxs ) {
+            v %= bl.size() + 1;
+            auto right = bl.split( std::next( bl.begin(), v ) );
+            if ( !right.empty() )
+                right.erase( right.begin() );
+            right.concat( std::move( bl ) );
+            bl = std::move( right );
+            if ( v < vals.size() )
+                vals.erase( vals.begin() + v );
+            std::rotate( vals.begin(), vals.begin() + v, vals.end() );
+            bl.validate();
+            RC_ASSERT( std::equal( bl.begin(), bl.end(), vals.begin(), vals.end() ) );
+        }
+    } );
+    rc::check( "blist erase range", []( std::vector< int > vals, std::vector< std::pair< unsigned, unsigned > > ranges ) {
+        blist< int, 4, 6 > bl( vals.begin(), vals.end() );
+        for ( auto [ from, len ] : ranges ) {
+            from %= vals.size() + 1;
+            len %= vals.size() - from + 1;
+            auto it = bl.erase( std::next( bl.begin(), from ), std::next( bl.begin(), from + len ) );
+            vals.erase( vals.begin() + from, vals.begin() + from + len );
+            bl.validate();
+            RC_ASSERT( bl.size() == vals.size() );
+            RC_ASSERT( std::distance( bl.begin(), it ) == from );
+            RC_ASSERT( std::equal( bl.begin(), bl.end(), vals.begin(), vals.end() ) );
+        }
+    } );
+
+    rc::check( "blist insert range", []( std::vector< int > vals, std::vector< std::pair< unsigned, std::vector< int > > > ins ) {
+        blist< int, 6, 4 > bl( vals.begin(), vals.end() );
+        for ( auto &[ pos, range ] : ins ) {
+            pos %= vals.size() + 1;
+            auto it = bl.insert( std::next( bl.begin(), pos ), range.begin(), range.end() );
+            vals.insert( vals.begin() + pos, range.begin(), range.end() );
+            bl.validate();
+            RC_ASSERT( bl.size() == vals.size() );
+            RC_ASSERT( std::distance( bl.begin(), it ) == pos );
+            RC_ASSERT( std::equal( bl.begin(), bl.end(), vals.begin(), vals.end() ) );
+        }
+    } );
+    rc::check( "blist random access iterator", []( std::vector< int > vals, std::vector< std::pair< unsigned, unsigned > > jumps ) {
+        blist< int, 4, 4 > bl( vals.begin(), vals.end() );
+        const auto &cbl = bl;
+        RC_ASSERT( bl.end() - bl.begin() == ptrdiff_t( vals.size() ) );
+        for ( auto [ from, to ] : jumps ) {
+            from %= vals.size() + 1;
+            to %= vals.size() + 1;
+            auto it = bl.begin() + from;
+            auto cit = cbl.end() - ( vals.size() - to );
+            RC_ASSERT( it - bl.begin() == ptrdiff_t( from ) );
+            RC_ASSERT( cit - cbl.begin() == ptrdiff_t( to ) );
+            RC_ASSERT( cit - it == ptrdiff_t( to ) - ptrdiff_t( from ) );
+            RC_ASSERT( ( it < cit ) == ( from < to ) );
+            RC_ASSERT( ( it <= cit ) == ( from <= to ) );
+            RC_ASSERT( ( it + ( ptrdiff_t( to ) - ptrdiff_t( from ) ) ) == cit );
+            if ( to < vals.size() ) {
+                RC_ASSERT( it[ ptrdiff_t( to ) - ptrdiff_t( from ) ] == vals[ to ] );
+                RC_ASSERT( *cit == vals[ to ] );
+            }
+            it += ptrdiff_t( to ) - ptrdiff_t( from );
+            RC_ASSERT( it == cit );
+            it -= ptrdiff_t( to ) - ptrdiff_t( from );
+            RC_ASSERT( it - bl.begin() == ptrdiff_t( from ) );
+        }
+    } );
+
+    rc::check( "blist lower_bound", []( std::vector< int > vals, int val ) {
+        std::sort( vals.begin(), vals.end() );
+        blist< int, 4, 4 > bl( vals.begin(), vals.end() );
+        auto it = std::lower_bound( bl.begin(), bl.end(), val );
+        RC_ASSERT( it - bl.begin() == std::lower_bound( vals.begin(), vals.end(), val ) - vals.begin() );
+    } );
+    rc::check( "blist segments", []( std::vector< int > vals ) {
+        blist< int, 4, 4 > bl( vals.begin(), vals.end() );
+        const auto &cbl = bl;
+        std::vector< int > out;
+        for ( auto seg : cbl.segments() ) {
+            RC_ASSERT( !seg.empty() );
+            out.insert( out.end(), seg.begin(), seg.end() );
+        }
+        RC_ASSERT( out == vals );
+
+        for ( auto seg : bl.segments() )
+            for ( int &v : seg )
+                ++v;
+        out.clear();
+        bl.for_each_segment( [&]( int *b, int *e ) { out.insert( out.end(), b, e ); } );
+        for ( auto &v : vals )
+            ++v;
+        RC_ASSERT( out == vals );
+    } );
+
+    rc::check( "blist segmented algorithms", []( std::vector< int > vals, unsigned from, unsigned to, int val ) {
+        from %= vals.size() + 1;
+        to %= vals.size() + 1;
+        if ( from > to )
+            std::swap( from, to );
+        blist< int, 4, 4 > bl( vals.begin(), vals.end() );
+        auto first = bl.begin() + from, last = bl.begin() + to;
+        auto vfirst = vals.begin() + from, vlast = vals.begin() + to;
+
+        RC_ASSERT( accumulate( first, last, 0LL ) == std::accumulate( vfirst, vlast, 0LL ) );
+        RC_ASSERT( find( first, last, val ) - bl.begin() == std::find( vfirst, vlast, val ) - vals.begin() );
+
+        std::vector< int > out;
+        copy( first, last, std::back_inserter( out ) );
+        RC_ASSERT( std::equal( out.begin(), out.end(), vfirst, vlast ) );
+
+        fill( first, last, val );
+        std::fill( vfirst, vlast, val );
+        RC_ASSERT( std::equal( bl.begin(), bl.end(), vals.begin(), vals.end() ) );
+    } );
+    rc::check( "blist parallel algorithms", []( std::vector< int > vals, unsigned extra ) {
+        static thread_pool pool( 4 );
+        // make sure the list is big enough to be split into several tasks
+        vals.resize( vals.size() + extra % 8 * 1000 );
+        for ( size_t i = 0; i < vals.size(); ++i )
+            vals[ i ] = vals[ i ] ^ int( i );
+        blist< int, 8, 8 > bl( vals.begin(), vals.end() );
+        const auto &cbl = bl;
+
+        RC_ASSERT( cbl.parallel_reduce( 0LL, std::plus<>(), pool )
+                   == std::accumulate( vals.begin(), vals.end(), 0LL ) );
+        RC_ASSERT( cbl.parallel_reduce( 0, []( int a, int b ) { return std::max( a, b ); }, pool )
+                   == std::accumulate( vals.begin(), vals.end(), 0, []( int a, int b ) { return std::max( a, b ); } ) );
+
+        bl.parallel_transform( []( int x ) { return x / 2; }, pool );
+        for ( auto &v : vals )
+            v /= 2;
+        RC_ASSERT( std::equal( bl.begin(), bl.end(), vals.begin(), vals.end() ) );
+
+        std::atomic< long long > sum{ 0 };
+        cbl.parallel_for_each( [&]( int x ) { sum += x; }, pool );
+        bl.parallel_for_each( []( int &x ) { ++x; } );
+        RC_ASSERT( sum == std::accumulate( vals.begin(), vals.end(), 0LL ) );
+        for ( auto &v : vals )
+            ++v;
+        RC_ASSERT( std::equal( bl.begin(), bl.end(), vals.begin(), vals.end() ) );
+    } );
+
+    rc::check( "blist sort", []( std::vector< int > vals, unsigned extra ) {
+        static thread_pool pool( 4 );
+        // make sure the list is big enough to be sorted in several runs
+        vals.resize( vals.size() + extra % 4 * 3000 );
+        // the second component tells whether equivalent elements kept their order
+        std::vector< std::pair< int, size_t > > ref;
+        for ( size_t i = 0; i < vals.size(); ++i )
+            ref.emplace_back( ( vals[ i ] ^ int( i * 7919 ) ) % 50, i );
+        auto by_key = []( const auto &a, const auto &b ) { return a.first < b.first; };
+
+        blist< std::pair< int, size_t >, 8, 8 > bl( ref.begin(), ref.end() );
+        deque_blist< std::pair< int, size_t >, 8, 8 > dl( ref.begin(), ref.end() );
+        bl.sort( by_key, pool );
+        dl.sort( by_key, pool );
+        std::stable_sort( ref.begin(), ref.end(), by_key );
+        bl.validate();
+        dl.validate();
+        RC_ASSERT( std::equal( bl.begin(), bl.end(), ref.begin(), ref.end() ) );
+        RC_ASSERT( std::equal( dl.rbegin(), dl.rend(), ref.rbegin(), ref.rend() ) );
+
+        persistent_blist< int, 4, 4, sum_monoid< long long > > pl( vals.begin(), vals.end() );
+        auto snap = pl.snapshot();
+        pl.sort( std::greater<>() );
+        pl.validate();
+        RC_ASSERT( std::is_sorted( pl.begin(), pl.end(), std::greater<>() ) );
+        RC_ASSERT( pl.range_query( 0, pl.size() ) == std::accumulate( vals.begin(), vals.end(), 0LL ) );
+        RC_ASSERT( std::equal( snap.begin(), snap.end(), vals.begin(), vals.end() ) );
+    } );
+
+    rc::check( "blist sort/merge with a throwing comparator", []( std::vector< int > vals1, std::vector< int > vals2,
+                                                                   unsigned extra, unsigned limit ) {
+        static thread_pool pool( 4 );
+        vals1.resize( vals1.size() + extra % 4 * 1000 );
+        // throws on the limit-th comparison, the runs are sorted in the pool
+        std::atomic< size_t > calls = 0;
+        size_t fail = SIZE_MAX;
+        auto cmp = [&]( int a, int b ) {
+            if ( ++calls == fail )
+                throw std::runtime_error( "cmp" );
+            return a < b;
+        };
+        auto all = vals1;
+        blist< int, 4, 4 > bl( vals1.begin(), vals1.end() );
+        blist< int, 4, 4 >( bl ).sort( cmp, pool );
+        fail = limit % ( calls + 1 );
+        calls = 0;
+        try {
+            bl.sort( cmp, pool );
+            RC_ASSERT( std::is_sorted( bl.begin(), bl.end() ) );
+        } catch ( const std::runtime_error & ) {
+            RC_TAG( "sort threw" );
+        }
+        bl.validate();
+        // std::stable_sort of a run only leaves valid values, the merge of
+        // the runs keeps all elements
+        RC_ASSERT( bl.size() == all.size() );
+        std::set< int > known( all.begin(), all.end() );
+        RC_ASSERT( std::all_of( bl.begin(), bl.end(), [&]( int v ) { return known.count( v ); } ) );
+
+        bl.sort();
+        all.assign( bl.begin(), bl.end() );
+        std::sort( vals2.begin(), vals2.end() );
+        all.insert( all.end(), vals2.begin(), vals2.end() );
+        blist< int, 4, 4 > other( vals2.begin(), vals2.end() );
+        calls = 0;
+        fail = limit % ( all.size() + 1 );
+        try {
+            bl.merge( std::move( other ), cmp );
+            RC_ASSERT( std::is_sorted( bl.begin(), bl.end() ) );
+        } catch ( const std::runtime_error & ) {
+            RC_TAG( "merge threw" );
+        }
+        bl.validate();
+        other.validate();
+        RC_ASSERT( other.empty() );
+        RC_ASSERT( std::is_permutation( bl.begin(), bl.end(), all.begin(), all.end() ) );
+
+        // lists on different resources, each frees only its own nodes
+        counting_resource res1, res2;
+        {
+            std::sort( vals1.begin(), vals1.end() );
+            pmr_blist< int, 4, 4 > pl( vals1.begin(), vals1.end(), &res1 );
+            pmr_blist< int, 4, 4 > po( vals2.begin(), vals2.end(), &res2 );
+            all = vals1;
+            all.insert( all.end(), vals2.begin(), vals2.end() );
+            calls = 0;
+            fail = limit % ( all.size() + 1 );
+            try {
+                pl.merge( std::move( po ), cmp );
+                RC_ASSERT( std::is_sorted( pl.begin(), pl.end() ) );
+            } catch ( const std::runtime_error & ) {
+                RC_TAG( "pmr merge threw" );
+            }
+            pl.validate();
+            RC_ASSERT( po.empty() );
+            RC_ASSERT( std::is_permutation( pl.begin(), pl.end(), all.begin(), all.end() ) );
+            RC_ASSERT( res2.live == 0 );
+        }
+        RC_ASSERT( res1.live == 0 );
+    } );
+
+    rc::check( "blist sort with a comparator throwing in a multi-leaf run", []( std::vector< int > vals ) {
+        static thread_pool pool( 4 );
+        // moved-from strings are empty, a run is moved into a buffer to be
+        // sorted and at most the half std::stable_sort buffers may be lost
+        std::vector< std::string > all;
+        for ( int i = 0; i < 9; ++i )
+            vals.push_back( i );
+        for ( int v : vals )
+            all.push_back( "a string too long for SSO " + std::to_string( v ) );
+        blist< std::string, 4, 4 > bl( all.begin(), all.end() );
+        bool thrown = false;
+        try {
+            bl.sort( [&]( const std::string &a, const std::string &b ) {
+                    if ( !std::exchange( thrown, true ) )
+                        throw std::runtime_error( "cmp" );
+                    return a < b;
+                }, pool );
+        } catch ( const std::runtime_error & ) { }
+        RC_ASSERT( thrown );
+        bl.validate();
+        RC_ASSERT( bl.size() == all.size() );
+        std::vector< std::string > kept;
+        std::copy_if( bl.begin(), bl.end(), std::back_inserter( kept ),
+                      []( const std::string &s ) { return !s.empty(); } );
+        RC_ASSERT( kept.size() >= all.size() / 2 );
+        std::sort( kept.begin(), kept.end() );
+        std::sort( all.begin(), all.end() );
+        RC_ASSERT( std::includes( all.begin(), all.end(), kept.begin(), kept.end() ) );
+    } );
+
+    rc::check( "blist merge", []( std::vector< int > vals1, std::vector< int > vals2 ) {
+        std::sort( vals1.begin(), vals1.end() );
+        std::sort( vals2.begin(), vals2.end() );
+        // equivalent elements of the first list come first
+        auto by_key = []( const auto &a, const auto &b ) { return a.first < b.first; };
+        std::list< std::pair< int, int > > ref1, ref2;
+        for ( int v : vals1 )
+            ref1.emplace_back( v / 4, 1 );
+        for ( int v : vals2 )
+            ref2.emplace_back( v / 4, 2 );
+
+        using list = blist< std::pair< int, int >, 4, 4, void, std::allocator< std::pair< int, int > >, false, true >;
+        list a( ref1.begin(), ref1.end() );
+        list b( ref2.begin(), ref2.end() );
+        b.set_min_fill( 0.25 );
+        a.merge( std::move( b ), by_key );
+        ref1.merge( ref2, by_key );
+        a.validate();
+        b.validate();
+        RC_ASSERT( b.empty() );
+        RC_ASSERT( a.min_fill() == 0.25 );
+        RC_ASSERT( std::equal( a.begin(), a.end(), ref1.begin(), ref1.end() ) );
+        RC_ASSERT( std::equal( a.rbegin(), a.rend(), ref1.rbegin(), ref1.rend() ) );
+        // the leaves are packed full
+        RC_ASSERT( a.stats().leaves == ( ref1.size() + 3 ) / 4 );
+
+        b.push_back( { 0, 3 } );
+        a.merge( std::move( b ), by_key );
+        a.validate();
+        RC_ASSERT( a.size() == ref1.size() + 1 );
+        RC_ASSERT( std::is_sorted( a.begin(), a.end(), by_key ) );
+    } );
+
+    rc::check( "blist range_query", []( std::vector< int > vals, std::vector< std::tuple< unsigned, unsigned, unsigned, int > > ops ) {
+        blist< int, 4, 4, sum_monoid< long long > > sum( vals.begin(), vals.end() );
+        blist< int, 4, 4, min_monoid< int > > min( vals.begin(), vals.end() );
+        auto check = [&]( unsigned from, unsigned to ) {
+            sum.validate();
+            min.validate();
+            from %= vals.size() + 1;
+            to %= vals.size() + 1;
+            if ( from > to )
+                std::swap( from, to );
+            RC_ASSERT( sum.range_query( from, to ) == std::accumulate( vals.begin() + from, vals.begin() + to, 0LL ) );
+            RC_ASSERT( min.range_query( from, to ) == std::accumulate( vals.begin() + from, vals.begin() + to, std::numeric_limits< int >::max(),
+                                                                       []( int a, int b ) { return std::min( a, b ); } ) );
+        };
+        for ( auto [ op, a, b, val ] : ops ) {
+            unsigned pos = a % ( vals.size() + 1 );
+            switch ( op % 5 ) {
+            case 0:
+                sum.insert( sum.begin() + pos, val );
+                min.insert( min.begin() + pos, val );
+                vals.insert( vals.begin() + pos, val );
+                break;
+            case 1:
+                if ( pos == vals.size() )
+                    break;
+                sum.erase( sum.begin() + pos );
+                min.erase( min.begin() + pos );
+                vals.erase( vals.begin() + pos );
+                break;
+            case 2:
+                if ( pos == vals.size() )
+                    break;
+                sum.modify( sum.begin() + pos, [&]( int &x ) { x = val; } );
+                min.modify( min.begin() + pos, [&]( int &x ) { x = val; } );
+                vals[ pos ] = val;
+                break;
+            case 3: {
+                std::vector< int > range( b % 20, val );
+                sum.insert( sum.begin() + pos, range.begin(), range.end() );
+                min.insert( min.begin() + pos, range.begin(), range.end() );
+                vals.insert( vals.begin() + pos, range.begin(), range.end() );
+                break;
+            }
+            case 4: {
+                unsigned len = b % ( vals.size() - pos + 1 );
+                sum.erase( sum.begin() + pos, sum.begin() + pos + len );
+                min.erase( min.begin() + pos, min.begin() + pos + len );
+                vals.erase( vals.begin() + pos, vals.begin() + pos + len );
+                break;
+            }
+            }
+            check( a, b );
+        }
+        fill( sum.begin(), sum.begin() + vals.size() / 2, 1 );
+        fill( min.begin(), min.begin() + vals.size() / 2, 1 );
+        std::fill( vals.begin(), vals.begin() + vals.size() / 2, 1 );
+        check( 0, vals.size() );
+        check( vals.size() / 3, vals.size() );
+    } );
+
+    rc::check( "blist node_pool", []( std::vector< int > vals, std::vector< std::pair< unsigned, int > > ops ) {
+        // small enough for each node type to fit into a single slab
+        vals.resize( std::min( vals.size(), size_t( 400 ) ) );
+        counting_resource upstream;
+        {
+            node_pool pool( &upstream );
+            pmr_blist< int, 4, 4 > bl( vals.begin(), vals.end(), &pool );
+            for ( auto [ pos, val ] : ops ) {
+                pos %= vals.size() + 1;
+                bl.insert( bl.begin() + pos, val );
+                bl.erase( bl.begin() + pos / 2 );
+                vals.insert( vals.begin() + pos, val );
+                vals.erase( vals.begin() + pos / 2 );
+                bl.validate();
+            }
+            RC_ASSERT( std::equal( bl.begin(), bl.end(), vals.begin(), vals.end() ) );
+            RC_ASSERT( upstream.allocs <= 2 );
+
+            auto right = bl.split( bl.begin() + vals.size() / 2 );
+            bl.concat( std::move( right ) );
+            RC_ASSERT( std::equal( bl.begin(), bl.end(), vals.begin(), vals.end() ) );
+
+            // different resources, the elements have to be moved one by one
+            pmr_blist< int, 4, 4 > other( std::pmr::new_delete_resource() );
+            other = std::move( bl );
+            other.validate();
+            RC_ASSERT( other.get_allocator().resource() == std::pmr::new_delete_resource() );
+            RC_ASSERT( std::equal( other.begin(), other.end(), vals.begin(), vals.end() ) );
+            bl = other;
+            bl.validate();
+            RC_ASSERT( bl.get_allocator().resource() == &pool );
+            RC_ASSERT( std::equal( bl.begin(), bl.end(), vals.begin(), vals.end() ) );
+        }
+        RC_ASSERT( upstream.live == 0 );
+    } );
+
+    rc::check( "blist pooled", []( std::vector< int > vals, unsigned pos ) {
+        using list = pooled_blist< int, 4, 4 >;
+        using persistent = blist< int, 4, 4, void, pool_allocator< int >, true >;
+        pos %= vals.size() + 1;
+        counting_resource upstream;
+        std::optional< list > right;
+        std::optional< persistent::snapshot_type > snap;
+        {
+            list bl( vals.begin(), vals.end(), pool_allocator< int >( &upstream, 1024 ) );
+            list copy = bl;
+            RC_ASSERT( copy.get_allocator() != bl.get_allocator() );
+            RC_ASSERT( copy.get_allocator().pool().upstream_resource() == &upstream );
+            RC_ASSERT( std::equal( copy.begin(), copy.end(), vals.begin(), vals.end() ) );
+            right = bl.split( bl.begin() + pos );
+            RC_ASSERT( right->get_allocator() == bl.get_allocator() );
+            list moved = std::move( bl );
+            bl.insert( bl.end(), vals.begin(), vals.end() );
+            bl.validate();
+            RC_ASSERT( std::equal( bl.begin(), bl.end(), vals.begin(), vals.end() ) );
+            moved.insert( moved.end(), right->begin(), right->end() );
+            RC_ASSERT( std::equal( moved.begin(), moved.end(), vals.begin(), vals.end() ) );
+
+            persistent pl( vals.begin(), vals.end(), pool_allocator< int >( &upstream ) );
+            snap = pl.snapshot();
+        }
+        // the split off part and the snapshot keep their pools
+        right->validate();
+        RC_ASSERT( std::equal( right->begin(), right->end(), vals.begin() + pos, vals.end() ) );
+        RC_ASSERT( std::equal( snap->begin(), snap->end(), vals.begin(), vals.end() ) );
+        RC_ASSERT( upstream.live > 0 || vals.empty() );
+        right.reset();
+        snap.reset();
+        RC_ASSERT( upstream.live == 0 );
+    } );
+
+    rc::check( "blist shrink_to_fit", []( std::vector< int > vals, unsigned keep ) {
+        keep = keep % 8 + 1;
+        counting_resource upstream;
+        {
+            node_pool pool( &upstream, 1024 );
+            pmr_blist< int, 4, 4 > bl( vals.begin(), vals.end(), &pool );
+            for ( int i = 0; i < 20; ++i )
+                bl.insert( bl.end(), vals.begin(), vals.end() );
+            size_t grown = upstream.live;
+            // erase all but every keep-th element, from the back
+            std::vector< int > ref( bl.begin(), bl.end() );
+            for ( size_t i = ref.size(); i-- > 0; ) {
+                if ( i % keep != 0 ) {
+                    bl.erase( bl.begin() + i );
+                    ref.erase( ref.begin() + i );
+                }
+            }
+            bl.shrink_to_fit();
+            bl.validate();
+            RC_ASSERT( std::equal( bl.begin(), bl.end(), ref.begin(), ref.end() ) );
+            RC_ASSERT( upstream.live <= grown );
+            if ( keep > 2 && vals.size() >= 4 ) // spans enough slabs to free some
+                RC_ASSERT( upstream.live < grown );
+            // the pool still works after trimming
+            bl.insert( bl.begin(), vals.begin(), vals.end() );
+            ref.insert( ref.begin(), vals.begin(), vals.end() );
+            bl.validate();
+            RC_ASSERT( std::equal( bl.begin(), bl.end(), ref.begin(), ref.end() ) );
+        }
+        RC_ASSERT( upstream.live == 0 );
+    } );
+
+    rc::check( "blist snapshots", []( std::vector< int > vals, std::vector< std::tuple< unsigned, unsigned, int > > ops ) {
+        using list = blist< int, 4, 4, sum_monoid< long long >, std::pmr::polymorphic_allocator< int >, true >;
+        counting_resource upstream;
+        {
+            list bl( vals.begin(), vals.end(), &upstream );
+            size_t initial = upstream.live;
+            std::vector< std::pair< list::snapshot_type, std::vector< int > > > history;
+            history.emplace_back( bl.snapshot(), vals );
+            for ( auto [ op, a, val ] : ops ) {
+                unsigned pos = a % ( vals.size() + 1 );
+                switch ( op % 5 ) {
+                case 0:
+                    bl.insert( bl.begin() + pos, val );
+                    vals.insert( vals.begin() + pos, val );
+                    break;
+                case 1:
+                    if ( pos == vals.size() )
+                        break;
+                    bl.erase( bl.begin() + pos );
+                    vals.erase( vals.begin() + pos );
+                    break;
+                case 2:
+                    if ( pos == vals.size() )
+                        break;
+                    bl.modify( bl.begin() + pos, [&]( int &x ) { x = val; } );
+                    vals[ pos ] = val;
+                    break;
+                case 3: {
+                    auto right = bl.split( bl.begin() + pos );
+                    bl.concat( std::move( right ) );
+                    break;
+                }
+                case 4: {
+                    unsigned len = unsigned( val ) % ( vals.size() - pos + 1 );
+                    bl.erase( bl.begin() + pos, bl.begin() + pos + len );
+                    vals.erase( vals.begin() + pos, vals.begin() + pos + len );
+                    break;
+                }
+                }
+                bl.validate();
+                RC_ASSERT( std::equal( bl.begin(), bl.end(), vals.begin(), vals.end() ) );
+                history.emplace_back( bl.snapshot(), vals );
+            }
+            // path copying, every operation copies O(log n) nodes
+            RC_ASSERT( upstream.live <= initial + 4 * ops.size() * ( bl.depth() + 2 ) );
+
+            for ( auto &[ snap, expected ] : history ) {
+                // assigning a default constructed view drops the snapshot
+                list::snapshot_type empty, copy = snap;
+                copy = empty;
+                RC_ASSERT( copy.empty() );
+                copy = std::move( empty );
+                RC_ASSERT( copy.empty() );
+                copy = snap;
+                RC_ASSERT( copy.size() == expected.size() );
+                RC_ASSERT( std::equal( copy.begin(), copy.end(), expected.begin(), expected.end() ) );
+                RC_ASSERT( std::equal( std::make_reverse_iterator( copy.end() ), std::make_reverse_iterator( copy.begin() ),
+                                       expected.rbegin(), expected.rend() ) );
+                RC_ASSERT( copy.range_query( 0, copy.size() ) == std::accumulate( expected.begin(), expected.end(), 0LL ) );
+                for ( size_t i = 0; i < expected.size(); i += 7 )
+                    RC_ASSERT( copy[ i ] == expected[ i ] );
+                std::vector< int > out;
+                copy.for_each_segment( [&]( const int *b, const int *e ) { out.insert( out.end(), b, e ); } );
+                RC_ASSERT( out == expected );
+            }
+
+            // restore the first version
+            bl = list( history.front().first.begin(), history.front().first.end(), &upstream );
+            bl.validate();
+            RC_ASSERT( std::equal( bl.begin(), bl.end(), history.front().second.begin(), history.front().second.end() ) );
+            history.clear();
+        }
+        RC_ASSERT( upstream.live == 0 );
+    } );
+
+    rc::check( "blist stats + counters", []( std::vector< int > vals, std::vector< unsigned > idxs ) {
+        using list = blist< int, 4, 4, void, std::allocator< int >, false, true >;
+        list bl;
+        for ( size_t i = 0; i < vals.size(); ++i )
+            bl.insert( bl.begin() + idxs.size() % ( bl.size() + 1 ), vals[ i ] );
+        auto s = bl.stats();
+        auto c = bl.counters();
+        size_t nodes = s.leaves + s.internal_nodes;
+        RC_ASSERT( s.depth == bl.depth() );
+        RC_ASSERT( s.bytes_live == bl.size() * sizeof( int ) );
+        RC_ASSERT( s.bytes_used >= s.bytes_live );
+        RC_ASSERT( size_t( std::distance( bl.segments().begin(), bl.segments().end() ) ) == s.leaves );
+        RC_ASSERT( std::accumulate( s.leaf_occupancy, s.leaf_occupancy + blist_stats::buckets, size_t( 0 ) ) == s.leaves );
+        RC_ASSERT( std::accumulate( s.internal_occupancy, s.internal_occupancy + blist_stats::buckets, size_t( 0 ) ) == s.internal_nodes );
+        // inserts only add nodes, by splits and by growing new roots
+        RC_ASSERT( c.allocations == nodes );
+        RC_ASSERT( nodes == ( bl.empty() ? 0 : c.splits + s.depth ) );
+        RC_ASSERT( c.merges == 0 );
+        RC_ASSERT( c.borrows == 0 );
+
+        // single erases free nodes by merges and by dropping roots
+        for ( unsigned i : idxs ) {
+            if ( bl.size() < 2 )
+                break;
+            bl.erase( bl.begin() + i % bl.size() );
+        }
+        auto s2 = bl.stats();
+        auto c2 = bl.counters();
+        RC_ASSERT( c2.allocations == c.allocations );
+        RC_ASSERT( nodes - s2.leaves - s2.internal_nodes == c2.merges + s.depth - s2.depth );
+        bl.reset_counters();
+        RC_ASSERT( bl.counters().splits == 0 );
+        RC_ASSERT( bl.counters().merges == 0 );
+    } );
+
+    rc::check( "blist mmap", []( std::vector< int > vals, std::vector< unsigned > idxs ) {
+        blist< int, 4, 4 > bl( vals.begin(), vals.end() );
+        for ( unsigned i : idxs )
+            bl.insert( bl.begin() + i % ( bl.size() + 1 ), int( i ) );
+        std::vector< int > expected( bl.begin(), bl.end() );
+        std::vector< std::vector< int > > leaves;
+        bl.for_each_segment( [&]( const int *b, const int *e ) { leaves.emplace_back( b, e ); } );
+
+        char path[] = "/tmp/blist_mmap_XXXXXX";
+        int fd = mkstemp( path );
+        RC_ASSERT( fd >= 0 );
+        close( fd );
+        {
+            std::ofstream out( path, std::ios::binary );
+            save_blist( out, bl );
+        }
+        {
+            mapped_blist< int > m( path );
+            RC_ASSERT( m.size() == expected.size() );
+            RC_ASSERT( m.leaves() == leaves.size() );
+            RC_ASSERT( std::equal( m.begin(), m.end(), expected.begin(), expected.end() ) );
+            for ( size_t i = 0; i < m.size(); i += 5 )
+                RC_ASSERT( m[ i ] == expected[ i ] );
+            std::vector< std::vector< int > > mleaves;
+            m.for_each_segment( [&]( const int *b, const int *e ) { mleaves.emplace_back( b, e ); } );
+            RC_ASSERT( mleaves == leaves );
+
+            blist< int, 4, 4 > copy( m.begin(), m.end() );
+            copy.validate();
+            RC_ASSERT( std::equal( copy.begin(), copy.end(), expected.begin(), expected.end() ) );
+            auto moved = std::move( m );
+            RC_ASSERT( moved.size() == expected.size() );
+        }
+        bool threw = false;
+        try {
+            mapped_blist< long long > wrong( path );
+        } catch ( blist_file_error & ) {
+            threw = true;
+        }
+        RC_ASSERT( threw );
+        if ( !expected.empty() ) {
+            RC_ASSERT( truncate( path, off_t( sizeof( blist_file_header ) + 4 * expected.size() - 1 ) ) == 0 );
+            threw = false;
+            try {
+                mapped_blist< int > truncated( path );
+            } catch ( blist_file_error & ) {
+                threw = true;
+            }
+            RC_ASSERT( threw );
+        }
+        unlink( path );
+    } );
+
+    rc::check( "deque_blist", []( std::vector< std::tuple< int, int, int > > ops ) {
+        deque_blist< int, 6, 4 > bl;
+        std::deque< int > deq;
+        for ( auto [ op, v1, v2 ] : ops ) {
+            size_t idx = deq.empty() ? 0 : std::abs( v1 ) % deq.size();
+            switch ( std::abs( op ) % 4 ) {
+                case 0:
+                    bl.push_front( v2 );
+                    deq.push_front( v2 );
+                    break;
+                case 1:
+                    bl.insert( bl.begin() + idx, v2 );
+                    deq.insert( deq.begin() + idx, v2 );
+                    break;
+                case 2:
+                    if ( !deq.empty() ) {
+                        bl.erase( bl.begin() + idx );
+                        deq.erase( deq.begin() + idx );
+                    }
+                    break;
+                default:
+                    if ( !deq.empty() ) {
+                        size_t last = idx + std::abs( v2 ) % ( deq.size() - idx + 1 );
+                        bl.erase( bl.begin() + idx, bl.begin() + last );
+                        deq.erase( deq.begin() + idx, deq.begin() + last );
+                    }
+            }
+            bl.validate();
+        }
+        RC_ASSERT( std::equal( bl.begin(), bl.end(), deq.begin(), deq.end() ) );
+        std::vector< int > out;
+        bl.for_each_segment( [&]( const int *b, const int *e ) { out.insert( out.end(), b, e ); } );
+        RC_ASSERT( std::equal( out.begin(), out.end(), deq.begin(), deq.end() ) );
+        out.clear();
+        for ( auto seg : bl.segments() )
+            out.insert( out.end(), seg.begin(), seg.end() );
+        RC_ASSERT( std::equal( out.begin(), out.end(), deq.begin(), deq.end() ) );
+        if ( !deq.empty() )
+            RC_ASSERT( find( bl.begin(), bl.end(), deq.back() ) - bl.begin() == std::find( deq.begin(), deq.end(), deq.back() ) - deq.begin() );
+    } );
+
+    rc::check( "blist cursor", []( std::vector< int > init, std::vector< std::pair< int, int > > ops ) {
+        auto run = [&]( auto bl ) {
+            std::vector< int > ref( init.begin(), init.end() );
+            size_t pos = ref.size() / 2;
+            {
+                auto c = bl.cursor_at( bl.begin() + pos );
+                for ( auto [ op, v ] : ops ) {
+                    switch ( std::abs( op ) % 6 ) {
+                        case 0:
+                        case 1:
+                            c.insert( v );
+                            ref.insert( ref.begin() + pos++, v );
+                            break;
+                        case 2:
+                            if ( pos < ref.size() ) {
+                                c.erase();
+                                ref.erase( ref.begin() + pos );
+                            }
+                            break;
+                        case 3:
+                            if ( pos < ref.size() ) {
+                                ++c;
+                                ++pos;
+                            }
+                            break;
+                        case 4:
+                            if ( pos > 0 ) {
+                                --c;
+                                --pos;
+                            }
+                            break;
+                        default: {
+                            ptrdiff_t n = v % 12;
+                            n = std::clamp< ptrdiff_t >( n, -ptrdiff_t( pos ), ptrdiff_t( ref.size() - pos ) );
+                            c += n;
+                            pos += n;
+                        }
+                    }
+                    RC_ASSERT( bl.size() == ref.size() );
+                    RC_ASSERT( c.index() == pos );
+                    RC_ASSERT( c.at_end() == ( pos == ref.size() ) );
+                    if ( pos < ref.size() )
+                        RC_ASSERT( *c == ref[ pos ] );
+                }
+                auto it = c.position();
+                RC_ASSERT( size_t( it - bl.begin() ) == pos );
+                bl.validate();
+                c.insert( 42 );
+                ref.insert( ref.begin() + pos, 42 );
+            }
+            bl.validate();
+            RC_ASSERT( std::equal( bl.begin(), bl.end(), ref.begin(), ref.end() ) );
+            return bl;
+        };
+        run( blist< int, 4, 4 >( init.begin(), init.end() ) );
+        auto sums = run( blist< int, 6, 4, sum_monoid< long long > >( init.begin(), init.end() ) );
+        RC_ASSERT( sums.range_query( 0, sums.size() ) == std::accumulate( sums.begin(), sums.end(), 0LL ) );
+
+        persistent_blist< int, 4, 4 > pl( init.begin(), init.end() );
+        auto snap = pl.snapshot();
+        run( std::move( pl ) );
+        RC_ASSERT( std::equal( snap.begin(), snap.end(), init.begin(), init.end() ) );
+    } );
+
+    rc::check( "blist compact", []( std::vector< int > vals, std::vector< unsigned > idxs, unsigned fill ) {
+        double fill_factor = ( fill % 5 ) / 4.0;
+        auto run = [&]( auto bl ) {
+            std::vector< int > ref( vals.begin(), vals.end() );
+            for ( unsigned i : idxs ) {
+                if ( ref.empty() )
+                    break;
+                bl.erase( bl.begin() + i % ref.size() );
+                ref.erase( ref.begin() + i % ref.size() );
+            }
+            size_t before = bl.stats().leaves;
+            bl.compact( fill_factor );
+            bl.validate();
+            RC_ASSERT( std::equal( bl.begin(), bl.end(), ref.begin(), ref.end() ) );
+            RC_ASSERT( std::equal( bl.rbegin(), bl.rend(), ref.rbegin(), ref.rend() ) );
+            auto s = bl.stats();
+            if ( fill_factor == 1.0 ) {
+                RC_ASSERT( s.leaves == ( ref.size() + 3 ) / 4 );
+                RC_ASSERT( s.leaves <= before );
+            }
+            return bl;
+        };
+        run( blist< int, 4, 4 >( vals.begin(), vals.end() ) );
+        run( deque_blist< int, 4, 4 >( vals.begin(), vals.end() ) );
+        auto sums = run( blist< int, 4, 4, sum_monoid< long long > >( vals.begin(), vals.end() ) );
+        RC_ASSERT( sums.range_query( 0, sums.size() ) == std::accumulate( sums.begin(), sums.end(), 0LL ) );
+
+        persistent_blist< int, 4, 4 > pl( vals.begin(), vals.end() );
+        auto snap = pl.snapshot();
+        run( std::move( pl ) );
+        RC_ASSERT( std::equal( snap.begin(), snap.end(), vals.begin(), vals.end() ) );
+    } );
+
+    rc::check( "blist compact out of memory", []( std::vector< int > vals, std::vector< unsigned > idxs, unsigned fail ) {
+        counting_resource res;
+        {
+            pmr_blist< int, 4, 4 > bl( vals.begin(), vals.end(), &res );
+            std::vector< int > ref( vals.begin(), vals.end() );
+            for ( unsigned i : idxs ) {
+                if ( ref.empty() )
+                    break;
+                bl.erase( bl.begin() + i % ref.size() );
+                ref.erase( ref.begin() + i % ref.size() );
+            }
+            res.fail_at = res.allocs + fail % 4;
+            try {
+                bl.compact( 0.5 );
+            } catch ( const std::bad_alloc & ) {
+                RC_TAG( "threw" );
+            }
+            bl.validate();
+            RC_ASSERT( std::equal( bl.begin(), bl.end(), ref.begin(), ref.end() ) );
+        }
+        RC_ASSERT( res.live == 0 );
+    } );
+
+    rc::check( "blist split/concat out of memory", []( std::vector< int > vals, unsigned pos, unsigned fail ) {
+        size_t at = pos % ( vals.size() + 1 );
+        auto check = [&]( auto &bl, auto &right ) {
+            bl.validate();
+            right.validate();
+            RC_ASSERT( std::equal( bl.begin(), bl.end(), vals.begin(), vals.begin() + at ) );
+            RC_ASSERT( std::equal( right.begin(), right.end(), vals.begin() + at, vals.end() ) );
+        };
+        auto run = [&]( auto tag, auto persistent ) {
+            using list = typename decltype( tag )::type;
+            counting_resource res;
+            [&] {
+                list bl( vals.begin(), vals.end(), &res ), right( &res );
+                // a snapshot makes the persistent list copy the nodes it changes
+                [[maybe_unused]] auto snap = [&] {
+                    if constexpr ( decltype( persistent )::value )
+                        return bl.snapshot();
+                    else
+                        return 0;
+                }();
+                res.fail_at = res.allocs + fail % 16;
+                try {
+                    right = bl.split( bl.begin() + at );
+                    check( bl, right );
+                } catch ( const std::bad_alloc & ) {
+                    RC_TAG( "split threw" );
+                    bl.validate();
+                    RC_ASSERT( std::equal( bl.begin(), bl.end(), vals.begin(), vals.end() ) );
+                    return;
+                }
+
+                res.fail_at = res.allocs + fail / 16 % 8;
+                try {
+                    bl.concat( std::move( right ) );
+                    bl.validate();
+                    RC_ASSERT( std::equal( bl.begin(), bl.end(), vals.begin(), vals.end() ) );
+                } catch ( const std::bad_alloc & ) {
+                    RC_TAG( "concat threw" );
+                    check( bl, right );
+                }
+            }();
+            RC_ASSERT( res.live == 0 );
+        };
+        run( std::common_type< pmr_blist< int, 4, 4 > >(), std::false_type() );
+        run( std::common_type< blist< int, 4, 4, sum_monoid< long long >, std::pmr::polymorphic_allocator< int >, true > >(),
+             std::true_type() );
+    } );
+
+    rc::check( "blist range insert/erase out of memory", []( std::vector< int > vals, std::vector< int > ins,
+                                                              unsigned a, unsigned b, unsigned fail ) {
+        counting_resource res;
+        {
+            pmr_blist< int, 4, 4 > bl( vals.begin(), vals.end(), &res );
+            // an operation which throws once the list is put back together
+            // leaves it with or without its effect
+            auto check = [&]( const std::vector< int > &before, const std::vector< int > &after, auto op ) {
+                try {
+                    op();
+                    bl.validate();
+                    RC_ASSERT( std::equal( bl.begin(), bl.end(), after.begin(), after.end() ) );
+                } catch ( const std::bad_alloc & ) {
+                    RC_TAG( "threw" );
+                    bl.validate();
+                    RC_ASSERT( std::equal( bl.begin(), bl.end(), before.begin(), before.end() )
+                               || std::equal( bl.begin(), bl.end(), after.begin(), after.end() ) );
+                }
+                vals.assign( bl.begin(), bl.end() );
+            };
+
+            size_t pos = a % ( vals.size() + 1 );
+            std::vector< int > inserted = vals;
+            inserted.insert( inserted.begin() + pos, ins.begin(), ins.end() );
+            res.fail_at = res.allocs + fail % 16;
+            check( vals, inserted, [&] { bl.insert( bl.begin() + pos, ins.begin(), ins.end() ); } );
+
+            size_t from = a % ( vals.size() + 1 );
+            size_t to = from + b % ( vals.size() - from + 1 );
+            std::vector< int > erased = vals;
+            erased.erase( erased.begin() + from, erased.begin() + to );
+            res.fail_at = res.allocs + fail / 16 % 16;
+            check( vals, erased, [&] { bl.erase( bl.begin() + from, bl.begin() + to ); } );
+        }
+        RC_ASSERT( res.live == 0 );
+    } );
+
+    rc::check( "blist min fill", []( std::vector< int > vals, std::vector< unsigned > idxs ) {
+        using list = blist< int, 8, 8 >;
+        list sparse( vals.begin(), vals.end() );
+        list dense( vals.begin(), vals.end() );
+        sparse.set_min_fill( 0.25 );
+        RC_ASSERT( sparse.min_fill() == 0.25 );
+        RC_ASSERT( dense.min_fill() == 0.5 );
+        std::vector< int > ref( vals.begin(), vals.end() );
+        for ( unsigned i : idxs ) {
+            if ( ref.empty() )
+                break;
+            sparse.erase( sparse.begin() + i % ref.size() );
+            dense.erase( dense.begin() + i % ref.size() );
+            ref.erase( ref.begin() + i % ref.size() );
+            sparse.validate();
+        }
+        RC_ASSERT( std::equal( sparse.begin(), sparse.end(), ref.begin(), ref.end() ) );
+
+        // the pieces keep the minimum, concat takes the lower one
+        auto right = sparse.split( sparse.begin() + ref.size() / 2 );
+        right.validate();
+        RC_ASSERT( right.min_fill() == 0.25 );
+        dense.concat( std::move( right ) );
+        dense.validate();
+        RC_ASSERT( dense.min_fill() == 0.25 );
+        auto copy = sparse;
+        RC_ASSERT( copy.min_fill() == 0.25 );
+        list empty;
+        empty.set_min_fill( 0.25 );
+        empty.concat( list( vals.begin(), vals.end() ) );
+        empty.validate();
+        RC_ASSERT( empty.min_fill() == 0.25 );
+
+        sparse.set_min_fill( 0.5 );
+        sparse.validate();
+        RC_ASSERT( std::equal( sparse.begin(), sparse.end(), ref.begin(), ref.begin() + ref.size() / 2 ) );
+    } );
+
+    rc::check( "ordered_blist", []( std::vector< std::pair< unsigned, int > > ops ) {
+        auto run = [&]( auto bl, auto ref ) {
+            for ( auto [ op, v ] : ops ) {
+                v %= 16;
+                switch ( op % 4 ) {
+                    case 0:
+                    case 1: {
+                        auto it = bl.insert_sorted( v );
+                        RC_ASSERT( *it == v );
+                        RC_ASSERT( size_t( it - bl.begin() )
+                                   == size_t( std::distance( ref.begin(), ref.upper_bound( v ) ) ) );
+                        ref.insert( v );
+                        break;
+                    }
+                    case 2:
+                        RC_ASSERT( bl.erase_value( v ) == ref.erase( v ) );
+                        break;
+                    default: {
+                        const auto &cbl = bl;
+                        auto lo = cbl.lower_bound( v );
+                        auto hi = cbl.upper_bound( v );
+                        RC_ASSERT( size_t( lo - cbl.begin() )
+                                   == size_t( std::distance( ref.begin(), ref.lower_bound( v ) ) ) );
+                        RC_ASSERT( size_t( hi - lo ) == ref.count( v ) );
+                        if ( lo != cbl.end() )
+                            RC_ASSERT( cbl[ lo - cbl.begin() ] == *ref.lower_bound( v ) );
+                    }
+                }
+                bl.validate();
+            }
+            RC_ASSERT( std::equal( bl.begin(), bl.end(), ref.begin(), ref.end() ) );
+            // the list stays ordered through the positional operations
+            auto right = bl.split( bl.begin() + bl.size() / 2 );
+            int last = right.empty() ? 0 : right.back();
+            right.insert_sorted( last );
+            ref.insert( last );
+            bl.concat( std::move( right ) );
+            bl.compact();
+            bl.validate();
+            RC_ASSERT( std::equal( bl.begin(), bl.end(), ref.begin(), ref.end() ) );
+        };
+        run( ordered_blist< int, std::less<>, 4, 4 >(), std::multiset< int >() );
+        run( ordered_blist< int, std::greater<>, 4, 4 >(), std::multiset< int, std::greater<> >() );
+        run( ordered_blist< int >(), std::multiset< int >() );
+    } );
+
+    rc::check( "blist apply_batch", []( std::vector< int > init, std::vector< std::tuple< bool, unsigned, int > > ops,
+                                        unsigned thin ) {
+        using edit = blist_edit< int >;
+        std::vector< edit > edits;
+        std::vector< bool > erased( init.size() );
+        // every thin-th element is erased to get whole subtrees underfull
+        thin %= 4;
+        for ( size_t i = 0; thin > 0 && i < init.size(); i += thin ) {
+            edits.push_back( { edit::erase, i } );
+            erased[ i ] = true;
+        }
+        for ( auto [ erase, pos, v ] : ops ) {
+            if ( erase && !init.empty() && !erased[ pos % init.size() ] ) {
+                edits.push_back( { edit::erase, pos % init.size() } );
+                erased[ pos % init.size() ] = true;
+            } else if ( !erase )
+                edits.push_back( { edit::insert, pos % ( init.size() + 1 ), v } );
+        }
+
+        // applied from the back, the erase of a position before the inserts
+        std::vector< int > ref( init.begin(), init.end() );
+        auto sorted = edits;
+        std::stable_sort( sorted.begin(), sorted.end(), []( auto &a, auto &b ) { return a.pos < b.pos; } );
+        for ( size_t j = sorted.size(), g; j > 0; j = g ) {
+            size_t pos = sorted[ j - 1 ].pos;
+            for ( g = j; g > 0 && sorted[ g - 1 ].pos == pos; --g )
+                if ( sorted[ g - 1 ].kind == edit::erase )
+                    ref.erase( ref.begin() + pos );
+            for ( size_t k = j; k > g; --k )
+                if ( sorted[ k - 1 ].kind == edit::insert )
+                    ref.insert( ref.begin() + pos, sorted[ k - 1 ].value );
+        }
+
+        auto run = [&]( auto bl ) {
+            bl.apply_batch( edits );
+            bl.validate();
+            RC_ASSERT( bl.size() == ref.size() );
+            RC_ASSERT( std::equal( bl.begin(), bl.end(), ref.begin(), ref.end() ) );
+            RC_ASSERT( std::equal( bl.rbegin(), bl.rend(), ref.rbegin(), ref.rend() ) );
+            return bl;
+        };
+        run( blist< int, 4, 4 >( init.begin(), init.end() ) );
+        run( deque_blist< int, 6, 4 >( init.begin(), init.end() ) );
+        auto sums = run( blist< int, 4, 4, sum_monoid< long long > >( init.begin(), init.end() ) );
+        RC_ASSERT( sums.range_query( 0, sums.size() ) == std::accumulate( ref.begin(), ref.end(), 0LL ) );
+
+        persistent_blist< int, 4, 4 > pl( init.begin(), init.end() );
+        auto snap = pl.snapshot();
+        run( std::move( pl ) );
+        RC_ASSERT( std::equal( snap.begin(), snap.end(), init.begin(), init.end() ) );
+    } );
+
+    rc::check( "blist apply_batch out of memory", []( unsigned n, std::vector< std::pair< bool, unsigned > > ops,
+                                                      unsigned fail ) {
+        using edit = blist_edit< int >;
+        // the elements are even, the inserted ones odd, all of them distinct
+        n %= 200;
+        std::vector< int > init( n );
+        for ( size_t i = 0; i < n; ++i )
+            init[ i ] = int( 2 * i );
+        std::vector< edit > edits;
+        std::vector< bool > erased( n );
+        for ( auto [ erase, pos ] : ops ) {
+            if ( erase && n > 0 && !erased[ pos % n ] ) {
+                edits.push_back( { edit::erase, pos % n } );
+                erased[ pos % n ] = true;
+            } else if ( !erase )
+                edits.push_back( { edit::insert, pos % ( n + 1 ), int( 2 * edits.size() + 1 ) } );
+        }
+
+        auto run = [&]( auto tag, auto persistent ) {
+            using list = typename decltype( tag )::type;
+            counting_resource res;
+            [&] {
+                list bl( init.begin(), init.end(), &res );
+                [[maybe_unused]] auto snap = [&] {
+                    if constexpr ( decltype( persistent )::value )
+                        return bl.snapshot();
+                    else
+                        return 0;
+                }();
+                res.fail_at = res.allocs + fail % 32;
+                try {
+                    bl.apply_batch( edits );
+                    bl.validate();
+                    return;
+                } catch ( const std::bad_alloc & ) {
+                    RC_TAG( "threw" );
+                }
+                // the elements not erased are all kept in order, the inserted
+                // ones at most once each
+                bl.validate();
+                std::vector< bool > seen( 2 * edits.size() + 1 );
+                size_t next = 0;
+                for ( int v : bl ) {
+                    if ( v % 2 == 0 ) {
+                        for ( ; next < size_t( v / 2 ); ++next )
+                            RC_ASSERT( erased[ next ] );
+                        RC_ASSERT( next == size_t( v / 2 ) );
+                        ++next;
+                    } else {
+                        RC_ASSERT( size_t( v ) < seen.size() && !seen[ v ] );
+                        seen[ v ] = true;
+                    }
+                }
+                for ( ; next < n; ++next )
+                    RC_ASSERT( erased[ next ] );
+                if constexpr ( decltype( persistent )::value )
+                    RC_ASSERT( std::equal( snap.begin(), snap.end(), init.begin(), init.end() ) );
+            }();
+            RC_ASSERT( res.live == 0 );
+        };
+        run( std::common_type< pmr_blist< int, 4, 4 > >(), std::false_type() );
+        run( std::common_type< blist< int, 4, 4, sum_monoid< long long >, std::pmr::polymorphic_allocator< int >, true > >(),
+             std::true_type() );
+    } );
 }
@@ -0,0 +1,170 @@
+#include <rapidcheck.h>
+#undef assert
+#define assert(X) RC_ASSERT(X)
+
+#include "small_vector.hpp"
+#include <cmath>
+#include <memory>
+#include <memory_resource>
+#include <sstream>
+#include <tuple>
+
+template class small_vector< int, 8 >;
+
+static_assert( std::is_nothrow_move_assignable_v< small_vector< int, 8 > > );
+// polymorphic_allocator does not propagate, the move may have to allocate
+static_assert( !std::is_nothrow_move_assignable_v< small_vector< int, 8, std::pmr::polymorphic_allocator< int > > > );
+
+namespace {
+
+// std::allocator counting the allocations it makes
+template< typename T >
+struct CountingAllocator : std::allocator< T > {
+    template< typename U >
+    struct rebind { using other = CountingAllocator< U >; };
+
+    CountingAllocator() = default;
+    template< typename U >
+    CountingAllocator( const CountingAllocator< U > & ) noexcept { } // NOLINT
+
+    T *allocate( size_t n ) {
+        ++allocations;
+        return std::allocator< T >::allocate( n );
+    }
+
+    static inline int allocations = 0;
+};
+
+template< typename SV, typename V >
+void check_equal( const SV &sv, const V &ref ) {
+    RC_ASSERT( sv.size() == ref.size() );
+    RC_ASSERT( std::equal( ref.begin(), ref.end(), sv.begin(), sv.end(),
+                           []( auto &a, auto &b ) { return *a == *b; } ) );
+}
+
+} // namespace
+
+void test_small_vector() {
+    rc::Config single;
+    single.max_success = 1;
+
+    rc::check( "small_vector stays inline", []( std::vector< int > vals ) {
+        vals.resize( std::min< size_t >( vals.size(), 5 ) );
+        CountingAllocator< int >::allocations = 0;
+        small_vector< int, 8, CountingAllocator< int > > sv;
+        for ( int v : vals )
+            sv.push_back( v );
+        sv.insert( sv.begin(), vals.begin(), vals.begin() + vals.size() / 2 );
+        sv.erase( sv.begin(), sv.begin() + vals.size() / 2 );
+        RC_ASSERT( sv.is_inline() );
+        RC_ASSERT( sv.capacity() == 8u );
+        RC_ASSERT( CountingAllocator< int >::allocations == 0 );
+        RC_ASSERT( std::equal( vals.begin(), vals.end(), sv.begin(), sv.end() ) );
+    } );
+
+    rc::check( "small_vector spill and shrink", []( std::vector< int > vals ) {
+        CountingAllocator< int >::allocations = 0;
+        small_vector< int, 4, CountingAllocator< int > > sv;
+        for ( int v : vals )
+            sv.push_back( v );
+        RC_ASSERT( std::equal( vals.begin(), vals.end(), sv.begin(), sv.end() ) );
+        RC_ASSERT( sv.is_inline() == ( vals.size() <= 4 ) );
+        // geometric growth
+        if ( vals.size() > 4 )
+            RC_ASSERT( CountingAllocator< int >::allocations <= 2 + int( std::log2( vals.size() ) ) );
+
+        while ( sv.size() > 3 )
+            sv.pop_back();
+        RC_ASSERT( sv.is_inline() == ( vals.size() <= 4 ) );
+        sv.shrink_to_fit();
+        RC_ASSERT( sv.is_inline() );
+        RC_ASSERT( std::equal( sv.begin(), sv.end(), vals.begin(), vals.begin() + sv.size() ) );
+    } );
+
+    rc::check( "small_vector insert/erase", []( std::vector< std::tuple< int, int, int > > ops ) {
+        std::vector< std::unique_ptr< int > > ref;
+        small_vector< std::unique_ptr< int >, 4 > sv;
+        for ( auto [ op, v1, v2 ] : ops ) {
+            size_t idx = std::abs( v1 ) % ( ref.size() + 1 );
+            switch ( std::abs( op ) % 5 ) {
+                case 0:
+                    sv.emplace( sv.begin() + idx, std::make_unique< int >( v2 ) );
+                    ref.emplace( ref.begin() + idx, std::make_unique< int >( v2 ) );
+                    break;
+                case 1:
+                    sv.push_back( std::make_unique< int >( v2 ) );
+                    ref.push_back( std::make_unique< int >( v2 ) );
+                    break;
+                case 2:
+                    if ( idx < ref.size() ) {
+                        size_t last = idx + std::abs( v2 ) % ( ref.size() - idx + 1 );
+                        auto it = sv.erase( sv.begin() + idx, sv.begin() + last );
+                        RC_ASSERT( it == sv.begin() + idx );
+                        ref.erase( ref.begin() + idx, ref.begin() + last );
+                    }
+                    break;
+                case 3: {
+                    std::unique_ptr< int > range[] = { std::make_unique< int >( v2 ), std::make_unique< int >( -v2 ) };
+                    sv.insert( sv.begin() + idx, std::make_move_iterator( std::begin( range ) ),
+                                                 std::make_move_iterator( std::end( range ) ) );
+                    ref.insert( ref.begin() + idx, std::make_unique< int >( v2 ) );
+                    ref.insert( ref.begin() + idx + 1, std::make_unique< int >( -v2 ) );
+                    break;
+                }
+                default:
+                    sv.shrink_to_fit();
+                    RC_ASSERT( sv.is_inline() == ( ref.size() <= 4 ) );
+            }
+            check_equal( sv, ref );
+        }
+    } );
+
+    rc::check( "small_vector copy/move", []( std::vector< int > vals1, std::vector< int > vals2 ) {
+        small_vector< int, 4 > a( vals1.begin(), vals1.end() );
+        small_vector< int, 4 > b( vals2.begin(), vals2.end() );
+        small_vector< int, 4 > c( a );
+        RC_ASSERT( c == a );
+        RC_ASSERT( c.is_inline() == ( vals1.size() <= 4 ) );
+        c = b;
+        RC_ASSERT( c == b );
+        small_vector< int, 4 > d( std::move( c ) );
+        RC_ASSERT( d == b );
+        RC_ASSERT( c.empty() );
+        d = std::move( a );
+        RC_ASSERT( std::equal( vals1.begin(), vals1.end(), d.begin(), d.end() ) );
+        RC_ASSERT( a.empty() );
+        d = { 1, 2, 3 };
+        RC_ASSERT( d.size() == 3u );
+        RC_ASSERT( ( d < b ) == std::lexicographical_compare( d.begin(), d.end(), vals2.begin(), vals2.end() ) );
+    } );
+
+    rc::check( "small_vector resize", []( unsigned count1, unsigned count2 ) {
+        count1 %= 20;
+        count2 %= 20;
+        auto p = std::make_shared< int >( 1 );
+        {
+            small_vector< std::shared_ptr< int >, 8 > sv( count1, p );
+            RC_ASSERT( p.use_count() == long( 1 + count1 ) );
+            sv.resize( count2 );
+            RC_ASSERT( sv.size() == count2 );
+            RC_ASSERT( p.use_count() == long( 1 + std::min( count1, count2 ) ) );
+            for ( size_t i = std::min( count1, count2 ); i < count2; ++i )
+                RC_ASSERT( !sv[ i ] );
+            // the value refers to an element, which moves if the vector spills
+            sv.push_back( p );
+            sv.resize( count1 + count2 + 1, sv.back() );
+            for ( size_t i = count2; i < sv.size(); ++i )
+                RC_ASSERT( sv.at( i ) == p );
+            RC_ASSERT_THROWS( sv.at( sv.size() ) );
+        }
+        RC_ASSERT( p.use_count() == 1 );
+    } );
+
+    rc::check( "small_vector input iterator", single, [] {
+        std::stringstream ss( "1 2 3 4 5 6" );
+        small_vector< int, 4 > sv{ std::istream_iterator< int >( ss ), std::istream_iterator< int >() };
+        RC_ASSERT( sv.size() == 6u );
+        RC_ASSERT( !sv.is_inline() );
+        RC_ASSERT( sv[ 5 ] == 6 );
+    } );
+}
@@ -0,0 +1,278 @@
+#include <rapidcheck.h>
+#undef assert
+#define assert(X) RC_ASSERT(X)
+
+#include "static_deque.hpp"
+#include <deque>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+template class static_deque< int, 128 >;
+
+namespace {
+
+struct LiveCounter {
+    explicit LiveCounter( int v ) : v( v ) { ++live; }
+    LiveCounter( const LiveCounter &o ) : v( o.v ) { ++live; }
+    LiveCounter( LiveCounter &&o ) : v( o.v ) { ++live; }
+    LiveCounter &operator=( const LiveCounter & ) = default;
+    LiveCounter &operator=( LiveCounter && ) = default;
+    ~LiveCounter() { --live; }
+
+    int v;
+    static inline int live = 0;
+};
+
+// LiveCounter whose construction throws once fail_in more have succeeded
+struct ThrowingCounter : LiveCounter {
+    explicit ThrowingCounter( int v = 0 ) : LiveCounter( ( check(), v ) ) { }
+    ThrowingCounter( const ThrowingCounter &o ) : LiveCounter( ( check(), o ) ) { }
+    ThrowingCounter( ThrowingCounter &&o ) : LiveCounter( ( check(), std::move( o ) ) ) { }
+    ThrowingCounter &operator=( const ThrowingCounter & ) = default;
+    ThrowingCounter &operator=( ThrowingCounter && ) = default;
+
+    static void check() {
+        if ( fail_in-- == 0 )
+            throw std::runtime_error( "ThrowingCounter" );
+    }
+    static inline int fail_in = -1;
+};
+
+// owns a heap int, relocatable by its bytes but not trivially copyable
+struct RelocatableBox {
+    explicit RelocatableBox( int v ) : p( std::make_unique< int >( v ) ) { }
+    std::unique_ptr< int > p;
+};
+
+} // namespace
+
+template<>
+struct is_trivially_relocatable< RelocatableBox > : std::true_type { };
+
+namespace {
+
+template< typename Deque, typename Std >
+void check_equal( const Deque &sd, const Std &ref ) {
+    RC_ASSERT( sd.size() == ref.size() );
+    RC_ASSERT( std::equal( ref.begin(), ref.end(), sd.begin(), sd.end(),
+                           []( auto &a, auto &b ) { return *a == *b; } ) );
+}
+
+} // namespace
+
+void test_static_deque() {
+    rc::Config single;
+    single.max_success = 1;
+
+    rc::check( "static_deque ctor", single, [] {
+        static_deque< int, 8 > sd;
+        RC_ASSERT( sd.empty() );
+        RC_ASSERT( sd.capacity() == 8u );
+
+        static_deque< int, 8 > sd2( 3, 7 );
+        RC_ASSERT( sd2.size() == 3u );
+        RC_ASSERT( sd2[ 2 ] == 7 );
+
+        static_deque< int, 8 > sd3{ 1, 2, 3 };
+        auto sd4 = sd3;
+        RC_ASSERT( sd4 == sd3 );
+        auto sd5 = std::move( sd4 );
+        RC_ASSERT( sd5 == sd3 );
+        RC_ASSERT( sd4.empty() );
+
+        RC_ASSERT_THROWS( ( static_deque< int, 2 >( 3 ) ) );
+        RC_ASSERT_THROWS( sd3.at( 3 ) );
+    } );
+
+    rc::check( "static_deque push/pop both ends", []( std::vector< std::pair< int, int > > ops ) {
+        std::deque< std::unique_ptr< int > > ref;
+        static_deque< std::unique_ptr< int >, 16 > sd;
+        for ( auto [ op, v ] : ops ) {
+            switch ( std::abs( op ) % 4 ) {
+                case 0:
+                    if ( sd.full() )
+                        RC_ASSERT_THROWS( sd.push_back( std::make_unique< int >( v ) ) );
+                    else {
+                        sd.push_back( std::make_unique< int >( v ) );
+                        ref.push_back( std::make_unique< int >( v ) );
+                    }
+                    break;
+                case 1:
+                    if ( sd.full() )
+                        RC_ASSERT_THROWS( sd.push_front( std::make_unique< int >( v ) ) );
+                    else {
+                        sd.push_front( std::make_unique< int >( v ) );
+                        ref.push_front( std::make_unique< int >( v ) );
+                    }
+                    break;
+                case 2:
+                    if ( !ref.empty() ) {
+                        sd.pop_back();
+                        ref.pop_back();
+                    }
+                    break;
+                default:
+                    if ( !ref.empty() ) {
+                        sd.pop_front();
+                        ref.pop_front();
+                    }
+            }
+            check_equal( sd, ref );
+        }
+    } );
+
+    rc::check( "static_deque insert/erase", []( std::vector< std::tuple< bool, int, int > > ops ) {
+        std::deque< std::unique_ptr< int > > ref;
+        static_deque< std::unique_ptr< int >, 16 > sd;
+        for ( auto [ erase, v1, v2 ] : ops ) {
+            if ( erase ) {
+                if ( ref.empty() )
+                    continue;
+                size_t idx1 = std::abs( v1 ) % ref.size();
+                size_t idx2 = idx1 + std::abs( v2 ) % ( ref.size() - idx1 ) + 1;
+                auto it = sd.erase( sd.begin() + idx1, sd.begin() + idx2 );
+                RC_ASSERT( it == sd.begin() + idx1 );
+                ref.erase( ref.begin() + idx1, ref.begin() + idx2 );
+            } else if ( !sd.full() ) {
+                size_t idx = ref.empty() ? 0 : std::abs( v1 ) % ( ref.size() + 1 );
+                auto it = sd.insert( sd.begin() + idx, std::make_unique< int >( v2 ) );
+                RC_ASSERT( **it == v2 );
+                ref.insert( ref.begin() + idx, std::make_unique< int >( v2 ) );
+            }
+            check_equal( sd, ref );
+        }
+    } );
+
+    rc::check( "static_deque relocatable insert/erase", []( std::vector< std::tuple< bool, int, int > > ops ) {
+        std::deque< int > ref;
+        static_deque< RelocatableBox, 16 > sd;
+        for ( auto [ erase, v1, v2 ] : ops ) {
+            if ( erase ) {
+                if ( ref.empty() )
+                    continue;
+                size_t idx1 = std::abs( v1 ) % ref.size();
+                size_t idx2 = idx1 + std::abs( v2 ) % ( ref.size() - idx1 ) + 1;
+                sd.erase( sd.begin() + idx1, sd.begin() + idx2 );
+                ref.erase( ref.begin() + idx1, ref.begin() + idx2 );
+            } else if ( !sd.full() ) {
+                // every other insert at the front, so that the ring wraps
+                size_t idx = v2 % 2 ? 0 : std::abs( v1 ) % ( ref.size() + 1 );
+                auto it = sd.emplace( sd.begin() + idx, v2 );
+                RC_ASSERT( *it->p == v2 );
+                ref.insert( ref.begin() + idx, v2 );
+            }
+            RC_ASSERT( std::equal( ref.begin(), ref.end(), sd.begin(), sd.end(),
+                                   []( int a, auto &b ) { return a == *b.p; } ) );
+        }
+    } );
+
+    rc::check( "static_deque insert range", []( std::vector< int > init, std::vector< int > vals, unsigned idx ) {
+        init.resize( std::min< size_t >( init.size(), 16 ) );
+        static_deque< int, 32 > sd( init.begin(), init.end() );
+        sd.push_front( 0 ); // moves the head off the first slot
+        sd.pop_front();
+        std::deque< int > ref( init.begin(), init.end() );
+        idx %= ref.size() + 1;
+        if ( ref.size() + vals.size() > 32 ) {
+            RC_ASSERT_THROWS( sd.insert( sd.begin() + idx, vals.begin(), vals.end() ) );
+            return;
+        }
+        sd.insert( sd.begin() + idx, vals.begin(), vals.end() );
+        ref.insert( ref.begin() + idx, vals.begin(), vals.end() );
+        RC_ASSERT( std::equal( ref.begin(), ref.end(), sd.begin(), sd.end() ) );
+    } );
+
+    rc::check( "static_deque spans", []( unsigned head, unsigned size, unsigned from, unsigned to ) {
+        static_deque< int, 16 > sd;
+        for ( unsigned i = 0; i < head % 16; ++i )
+            sd.push_back( 0 );
+        for ( unsigned i = 0; i < head % 16; ++i )
+            sd.pop_front();
+        size %= 17;
+        for ( unsigned i = 0; i < size; ++i )
+            sd.push_back( int( i ) );
+        from %= size + 1;
+        to = from + to % ( size - from + 1 );
+        std::vector< int > seen;
+        int calls = 0;
+        sd.for_each_span( from, to, [&]( const int *b, const int *e ) {
+                RC_ASSERT( b < e );
+                seen.insert( seen.end(), b, e );
+                ++calls;
+            } );
+        RC_ASSERT( calls <= 2 );
+        RC_ASSERT( std::equal( seen.begin(), seen.end(), sd.begin() + from, sd.begin() + to ) );
+    } );
+
+    rc::check( "static_deque lifetimes", []( std::vector< std::pair< int, int > > ops ) {
+        {
+            static_deque< LiveCounter, 8 > sd;
+            for ( auto [ op, v ] : ops ) {
+                switch ( std::abs( op ) % 4 ) {
+                    case 0:
+                        if ( !sd.full() )
+                            sd.emplace_front( v );
+                        break;
+                    case 1:
+                        if ( !sd.full() )
+                            sd.emplace( sd.begin() + std::abs( v ) % ( sd.size() + 1 ), v );
+                        break;
+                    case 2:
+                        if ( !sd.empty() )
+                            sd.erase( sd.begin() + std::abs( v ) % sd.size() );
+                        break;
+                    default:
+                        if ( !sd.empty() )
+                            sd.pop_front();
+                }
+                RC_ASSERT( LiveCounter::live == int( sd.size() ) );
+            }
+            auto copy = sd;
+            RC_ASSERT( LiveCounter::live == int( 2 * sd.size() ) );
+        }
+        RC_ASSERT( LiveCounter::live == 0 );
+    } );
+
+    rc::check( "static_deque throwing constructors", []( unsigned size, unsigned fail ) {
+        using deque = static_deque< ThrowingCounter, 8 >;
+        size = size % 9;
+        // the source is built from the back so that it wraps around
+        deque src;
+        for ( unsigned i = 0; i < size; ++i )
+            src.emplace_front( int( i ) );
+        std::vector< ThrowingCounter > vals( src.begin(), src.end() );
+        ThrowingCounter value( 7 );
+        int live = LiveCounter::live;
+        auto check = [ & ]( auto build ) {
+            ThrowingCounter::fail_in = int( fail % ( size + 1 ) );
+            try {
+                deque sd = build();
+                RC_ASSERT( sd.size() == size );
+            } catch ( const std::runtime_error & ) {
+                RC_TAG( "threw" );
+            }
+            ThrowingCounter::fail_in = -1;
+            RC_ASSERT( LiveCounter::live == live );
+        };
+        check( [ & ] { return deque( size ); } );
+        check( [ & ] { return deque( size, value ); } );
+        check( [ & ] { return deque( src ); } );
+        check( [ & ] { return deque( vals.begin(), vals.end() ); } );
+        check( [ & ] {
+            deque tmp( src );
+            return deque( std::move( tmp ) );
+        } );
+    } );
+
+    rc::check( "static_deque comparison", []( std::vector< int > vals1, std::vector< int > vals2 ) {
+        vals1.resize( std::min< size_t >( vals1.size(), 4 ) );
+        vals2.resize( std::min< size_t >( vals2.size(), 4 ) );
+        static_deque< int, 4 > sd1( vals1.begin(), vals1.end() );
+        static_deque< int, 4 > sd2( vals2.begin(), vals2.end() );
+        RC_ASSERT( ( sd1 == sd2 ) == ( vals1 == vals2 ) );
+        RC_ASSERT( ( sd1 < sd2 ) == ( vals1 < vals2 ) );
+        RC_ASSERT( ( sd1 >= sd2 ) == ( vals1 >= vals2 ) );
+    } );
+}
@@ -6,6 +6,7 @@
 #include <deque>
 #include <variant>
 #include <cstring>
+#include <string>
 
 template class static_vector< int, 128 >;
 
@@ -69,6 +70,35 @@ struct CADeleter {
     }
 };
 
+// owns a heap int, relocatable by its bytes but not trivially copyable
+struct RelocatableBox {
+    explicit RelocatableBox( int v ) : p( std::make_unique< int >( v ) ) { }
+    std::unique_ptr< int > p;
+};
+
+template<>
+struct is_trivially_relocatable< RelocatableBox > : std::true_type { };
+
+static_assert( is_trivially_relocatable_v< int > );
+static_assert( std::is_trivially_copyable_v< static_vector< int, 16 > > );
+struct Point { int x = 0, y = 0; }; // trivially copyable, not trivial
+static_assert( std::is_trivially_copyable_v< static_vector< Point, 16 > > );
+static_assert( !std::is_trivially_copyable_v< static_vector< std::string, 16 > > );
+
+constexpr static_vector< int, 8 > make_squares() {
+    static_vector< int, 8 > sv{ 0 };
+    for ( int i = 1; i < 6; ++i )
+        sv.push_back( i * i );
+    sv.pop_back();
+    return sv;
+}
+
+constexpr auto squares = make_squares();
+static_assert( squares.size() == 5 );
+static_assert( squares.at( 4 ) == 16 );
+static_assert( static_vector< int, 4 >( 3, 7 ).back() == 7 );
+static_assert( !is_trivially_relocatable_v< std::unique_ptr< int > > );
+
 void test_static_vector() {
     rc::Config single;
     single.max_success = 1;
@@ -142,9 +172,15 @@ void test_static_vector() {
         for ( int i = 0; i <= 4; ++i ) {
             RC_ASSERT( b[ i ] == i );
         }
-        RC_ASSERT( a.size() == 0u );
-        RC_ASSERT( a.empty() );
+        // the move of trivial elements is a copy
+        RC_ASSERT( a.size() == 5u );
         RC_ASSERT( b.size() == 5u );
+
+        static_vector< std::string, 16 > c{ "0", "1", "2" };
+        static_vector< std::string, 16 > d( std::move( c ) );
+        RC_ASSERT( c.empty() );
+        RC_ASSERT( d.size() == 3u );
+        RC_ASSERT( d[ 2 ] == "2" );
     } );
 
     rc::check( "static_vector assign copy", single, [] {
@@ -166,9 +202,30 @@ void test_static_vector() {
         for ( int i = 0; i <= 4; ++i ) {
             RC_ASSERT( b[ i ] == i );
         }
-        RC_ASSERT( a.size() == 0u );
-        RC_ASSERT( a.empty() );
+        RC_ASSERT( a.size() == 5u );
         RC_ASSERT( b.size() == 5u );
+
+        static_vector< std::string, 16 > c{ "0", "1", "2" };
+        static_vector< std::string, 16 > d{ "x" };
+        d = std::move( c );
+        RC_ASSERT( c.empty() );
+        RC_ASSERT( d.size() == 3u );
+        RC_ASSERT( d[ 2 ] == "2" );
+    } );
+
+    rc::check( "static_vector assign copy lifetimes", []( unsigned from, unsigned to ) {
+        auto p = std::make_shared< int >( 42 );
+        {
+            static_vector< std::shared_ptr< int >, 16 > a( from % 17, p );
+            static_vector< std::shared_ptr< int >, 16 > b( to % 17, p );
+            b = a;
+            RC_ASSERT( b.size() == a.size() );
+            RC_ASSERT( p.use_count() == long( 1 + 2 * a.size() ) );
+            b = { p, p };
+            RC_ASSERT( b.size() == 2u );
+            RC_ASSERT( p.use_count() == long( 3 + a.size() ) );
+        }
+        RC_ASSERT( p.use_count() == 1 );
     } );
 
     rc::check( "static_vector assign ilist", single, [] {
@@ -635,6 +692,68 @@ void test_static_vector() {
         }
     } );
 
+    rc::check( "static_vector relocatable insert/erase", []( std::vector< std::tuple< bool, int, int > > vals ) {
+        std::vector< int > stdvec;
+        static_vector< RelocatableBox, 16 > sv;
+        for ( auto [ pop, v1, v2 ] : vals ) {
+            if ( pop ) {
+                if ( sv.empty() )
+                    continue;
+                int idx1 = std::abs( v1 ) % stdvec.size();
+                int idx2 = idx1 + (std::abs( v2 ) % (stdvec.size() - idx1)) + 1;
+                sv.erase( sv.begin() + idx1, sv.begin() + idx2 );
+                stdvec.erase( stdvec.begin() + idx1, stdvec.begin() + idx2 );
+            } else if ( !sv.full() ) {
+                int idx1 = std::abs( v1 ) % ( stdvec.size() + 1 );
+                sv.emplace( sv.begin() + idx1, v2 );
+                stdvec.insert( stdvec.begin() + idx1, v2 );
+            }
+            RC_ASSERT( std::equal( stdvec.begin(), stdvec.end(), sv.begin(), sv.end(),
+                                   []( int a, auto &b ) { return a == *b.p; } ) );
+        }
+        auto moved = std::move( sv );
+        RC_ASSERT( sv.empty() );
+        RC_ASSERT( moved.size() == stdvec.size() );
+        sv = std::move( moved );
+        RC_ASSERT( moved.empty() );
+        RC_ASSERT( std::equal( stdvec.begin(), stdvec.end(), sv.begin(), sv.end(),
+                               []( int a, auto &b ) { return a == *b.p; } ) );
+    } );
+
+    rc::check( "static_vector splice", []( std::vector< int > dst, std::vector< int > src,
+                                           unsigned pos, unsigned first, unsigned last ) {
+        auto check = [&]( auto sv_dst, auto sv_src, auto value ) {
+            pos %= dst.size() + 1;
+            first %= src.size() + 1;
+            last = first + last % ( src.size() - first + 1 );
+            std::vector< int > exp_dst = dst, exp_src = src;
+            exp_dst.insert( exp_dst.begin() + pos, src.begin() + first, src.begin() + last );
+            exp_src.erase( exp_src.begin() + first, exp_src.begin() + last );
+            if ( exp_dst.size() > 16 ) {
+                RC_ASSERT_THROWS( sv_dst.splice( sv_dst.begin() + pos, sv_src,
+                                                 sv_src.begin() + first, sv_src.begin() + last ) );
+                return;
+            }
+            sv_dst.splice( sv_dst.begin() + pos, sv_src, sv_src.begin() + first, sv_src.begin() + last );
+            RC_ASSERT( std::equal( exp_dst.begin(), exp_dst.end(), sv_dst.begin(), sv_dst.end(),
+                                   [&]( int a, auto &b ) { return a == value( b ); } ) );
+            RC_ASSERT( std::equal( exp_src.begin(), exp_src.end(), sv_src.begin(), sv_src.end(),
+                                   [&]( int a, auto &b ) { return a == value( b ); } ) );
+        };
+        dst.resize( std::min< size_t >( dst.size(), 16 ) );
+        src.resize( std::min< size_t >( src.size(), 16 ) );
+
+        check( static_vector< int, 16 >( dst.begin(), dst.end() ),
+               static_vector< int, 16 >( src.begin(), src.end() ), []( int v ) { return v; } );
+
+        static_vector< std::unique_ptr< int >, 16 > u_dst, u_src;
+        for ( int v : dst )
+            u_dst.push_back( std::make_unique< int >( v ) );
+        for ( int v : src )
+            u_src.push_back( std::make_unique< int >( v ) );
+        check( std::move( u_dst ), std::move( u_src ), []( auto &p ) { return *p; } );
+    } );
+
     rc::check( "static_vector operator==", []( std::vector< int > vals ) {
         if ( vals.size() > 16 )
             vals.resize( 16 );
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Work-stealing thread pool. Every worker owns a task queue, it takes tasks
+// from the back of its own queue (most recently submitted first, which keeps
+// the data of the submitting task warm) and when that is empty, it steals
+// from the front of the other workers' queues. Tasks submitted from outside
+// of the pool are distributed round robin.
+class thread_pool
+{
+    struct queue {
+        std::mutex mtx;
+        std::deque< std::function< void() > > tasks;
+    };
+
+    std::vector< std::unique_ptr< queue > > _queues;
+    std::vector< std::thread > _threads;
+    std::atomic< size_t > _queued{ 0 };
+    std::atomic< size_t > _next{ 0 };
+    std::atomic< bool > _stop{ false };
+    std::mutex _sleep_mtx;
+    std::condition_variable _wake;
+
+    static inline thread_local thread_pool *_current = nullptr;
+    static inline thread_local size_t _current_idx = 0;
+
+  public:
+    explicit thread_pool( size_t threads = std::max( 1u, std::thread::hardware_concurrency() ) )
+    {
+        for ( size_t i = 0; i < threads; ++i )
+            _queues.push_back( std::make_unique< queue >() );
+        for ( size_t i = 0; i < threads; ++i )
+            _threads.emplace_back( [this, i] { _work( i ); } );
+    }
+
+    thread_pool( const thread_pool & ) = delete;
+    thread_pool &operator=( const thread_pool & ) = delete;
+
+    ~thread_pool() {
+        {
+            std::lock_guard< std::mutex > lk( _sleep_mtx );
+            _stop = true;
+        }
+        _wake.notify_all();
+        for ( auto &t : _threads )
+            t.join();
+    }
+
+    // pool shared by the parallel algorithms unless another one is given
+    static thread_pool &global() {
+        static thread_pool pool;
+        return pool;
+    }
+
+    size_t size() const noexcept { return _threads.size(); }
+
+    void submit( std::function< void() > task ) {
+        size_t idx = _current == this ? _current_idx : _next++ % _queues.size();
+        {
+            std::lock_guard< std::mutex > lk( _queues[ idx ]->mtx );
+            _queues[ idx ]->tasks.push_back( std::move( task ) );
+        }
+        ++_queued;
+        // taking the lock orders the increment before a worker goes to sleep
+        { std::lock_guard< std::mutex > lk( _sleep_mtx ); }
+        _wake.notify_one();
+    }
+
+    // Runs one queued task if there is any, returns false otherwise. Used by
+    // threads waiting for their tasks so that they help instead of blocking.
+    bool run_one() {
+        size_t own = _current == this ? _current_idx : 0;
+        std::function< void() > task;
+        if ( _current == this && _pop( *_queues[ own ], task, true ) )
+            return _run( task );
+        for ( size_t i = 0; i < _queues.size(); ++i ) {
+            if ( _pop( *_queues[ ( own + i ) % _queues.size() ], task, false ) )
+                return _run( task );
+        }
+        return false;
+    }
+
+  private:
+    static bool _pop( queue &q, std::function< void() > &task, bool back ) {
+        std::lock_guard< std::mutex > lk( q.mtx );
+        if ( q.tasks.empty() )
+            return false;
+        if ( back ) {
+            task = std::move( q.tasks.back() );
+            q.tasks.pop_back();
+        } else {
+            task = std::move( q.tasks.front() );
+            q.tasks.pop_front();
+        }
+        return true;
+    }
+
+    bool _run( std::function< void() > &task ) {
+        --_queued;
+        task();
+        return true;
+    }
+
+    void _work( size_t idx ) {
+        _current = this;
+        _current_idx = idx;
+        while ( !_stop ) {
+            if ( run_one() )
+                continue;
+            std::unique_lock< std::mutex > lk( _sleep_mtx );
+            _wake.wait( lk, [this] { return _stop || _queued > 0; } );
+        }
+    }
+};
+
+// A set of tasks running in a thread_pool which can be waited for. The
+// waiting thread executes queued tasks in the meantime. The first exception
+// thrown by a task is rethrown from wait().
+class task_group
+{
+    thread_pool &_pool;
+    std::atomic< size_t > _pending{ 0 };
+    std::mutex _error_mtx;
+    std::exception_ptr _error;
+
+  public:
+    explicit task_group( thread_pool &pool ) noexcept : _pool( pool ) { }
+
+    task_group( const task_group & ) = delete;
+    task_group &operator=( const task_group & ) = delete;
+
+    ~task_group() { _drain(); }
+
+    template< typename F >
+    void run( F f ) {
+        ++_pending;
+        try {
+            _pool.submit( [this, f = std::move( f )]() mutable {
+                    try {
+                        f();
+                    } catch ( ... ) {
+                        std::lock_guard< std::mutex > lk( _error_mtx );
+                        if ( !_error )
+                            _error = std::current_exception();
+                    }
+                    --_pending;
+                } );
+        } catch ( ... ) {
+            --_pending;
+            throw;
+        }
+    }
+
+    void wait() {
+        _drain();
+        if ( _error )
+            std::rethrow_exception( std::exchange( _error, nullptr ) );
+    }
+
+  private:
+    void _drain() noexcept {
+        while ( _pending > 0 ) {
+            if ( !_pool.run_one() )
+                std::this_thread::yield();
+        }
+    }
+};